@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef ALIGNED_BUFFER_H
+#define ALIGNED_BUFFER_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Heap buffer aligned to the cache line.
+// Memory is zeroed on allocation, so all pages
+// are already mapped when the audio thread uses them.
+template <typename T>
+class AlignedBuffer
+{
+public:
+
+  enum
+  {
+    kAlignment = 64
+  };
+
+  AlignedBuffer() {}
+
+  ~AlignedBuffer()
+  {
+    release();
+  }
+
+  AlignedBuffer(const AlignedBuffer&) = delete;
+  AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+  // Number of elements of T in one cache line
+  static size_t lineElements()
+  {
+    return kAlignment / sizeof(T);
+  }
+
+  // Rounds element count up to whole cache lines
+  static size_t roundUp(size_t count)
+  {
+    return (count + lineElements() - 1) / lineElements() * lineElements();
+  }
+
+  bool allocate(size_t count)
+  {
+    release();
+
+    if (count == 0)
+    {
+      return true;
+    }
+
+    size_t bytes = roundUp(count) * sizeof(T);
+
+#ifdef _WIN32
+    buf = (T*)_aligned_malloc(bytes, kAlignment);
+#else
+    void *p = nullptr;
+    if (posix_memalign(&p, kAlignment, bytes) != 0)
+    {
+      p = nullptr;
+    }
+    buf = (T*)p;
+#endif
+
+    if (!buf)
+    {
+      return false;
+    }
+
+    memset((void*)buf, 0, bytes);
+    length = count;
+    return true;
+  }
+
+  void release()
+  {
+    if (buf)
+    {
+#ifdef _WIN32
+      _aligned_free(buf);
+#else
+      free(buf);
+#endif
+    }
+    buf = nullptr;
+    length = 0;
+  }
+
+  T *data() const
+  {
+    return buf;
+  }
+
+  size_t size() const
+  {
+    return length;
+  }
+
+  T& operator[](size_t i) const
+  {
+    return buf[i];
+  }
+
+private:
+  T *buf = nullptr;
+  size_t length = 0;
+};
+
+#endif
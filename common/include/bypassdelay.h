@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef BYPASS_DELAY_H
+#define BYPASS_DELAY_H
+
+#include <string.h>
+
+#include <vector>
+#include <algorithm>
+
+// Delay line of the bypass path, 2 channels.
+// Keeps bypassed output aligned with the reported latency.
+// Samples are kept in double to pass 64-bit samples unchanged.
+class BypassDelay
+{
+public:
+
+  // Allocates memory, must not be called from the audio thread
+  void setup(int maxDelay)
+  {
+    size = maxDelay + 1;
+    line.assign(2 * size, 0.0);
+    pos = 0;
+  }
+
+  // Delays 'inputs' by 'delay' samples, 'delay' must not exceed
+  // 'maxDelay' given to setup(). Missing input channels
+  // are fed from the first one.
+  template <typename SampleType>
+  void process(SampleType **inputs, int numInputs,
+               SampleType **outputs, int numOutputs,
+               int numSamples, int delay)
+  {
+    int end = pos;
+
+    // First channel goes last, in place it may be
+    // the input of the others
+    for (int c = std::min(numOutputs, 2) - 1; c >= 0; c--)
+    {
+      SampleType *src = (c < numInputs) ? inputs[c] : inputs[0];
+      double *buf = line.data() + c * size;
+
+      // Without latency the line is not needed
+      if (delay == 0)
+      {
+        if (src != outputs[c])
+        {
+          memcpy(outputs[c], src, numSamples * sizeof(SampleType));
+        }
+        continue;
+      }
+
+      end = pos;
+      for (int i = 0; i < numSamples; i++)
+      {
+        buf[end] = src[i];
+
+        int readPos = end - delay;
+        if (readPos < 0)
+        {
+          readPos += size;
+        }
+        outputs[c][i] = buf[readPos];
+
+        if (++end == size)
+        {
+          end = 0;
+        }
+      }
+    }
+
+    pos = end;
+  }
+
+private:
+
+  std::vector<double> line;
+  int size = 0;
+  int pos = 0;
+};
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+
+#ifndef HALFBAND_H
+#define HALFBAND_H
+
+#include <math.h>
+#include <string.h>
+
+#include "alignedbuffer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HALFBAND_X86
+#include <immintrin.h>
+#endif
+
+// 2x interpolator and decimator with halfband lowpass filters.
+//
+// A halfband FIR has the center tap 1/2 and zeros at all other
+// even distances from it. Split into polyphase branches, one
+// branch is a pure delay and the other a symmetric FIR with
+// 'taps' coefficients per side, so a pair of high rate samples
+// costs 'taps' multiplies. The symmetric branch is evaluated
+// by a vector kernel, picked once from the CPU features.
+class Halfband
+{
+public:
+
+  // Computes 'count' outputs of the symmetric branch,
+  //
+  //   out [i] = sum (c [j] * (q [i + j] + q [i - 1 - j])), j < taps
+  //
+  // Vector kernels run across consecutive outputs: a coefficient
+  // is broadcast to all lanes and both input runs are unaligned
+  // loads, so there are no lane shuffles and no sums across lanes.
+  typedef void (*Kernel)(const float *q, const float *c, int taps, float *out, int count);
+
+  static void kernelPlain(const float *q, const float *c, int taps, float *out, int count)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      float sum = 0.0f;
+      for (int j = 0; j < taps; j++)
+      {
+        sum += c[j] * (q[i + j] + q[i - 1 - j]);
+      }
+      out[i] = sum;
+    }
+  }
+
+#ifdef HALFBAND_X86
+  __attribute__((target("sse")))
+  static void kernelSse(const float *q, const float *c, int taps, float *out, int count)
+  {
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+      __m128 sum = _mm_setzero_ps();
+      for (int j = 0; j < taps; j++)
+      {
+        __m128 x = _mm_add_ps(_mm_loadu_ps(q + i + j), _mm_loadu_ps(q + i - 1 - j));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(c[j]), x));
+      }
+      _mm_storeu_ps(out + i, sum);
+    }
+    kernelPlain(q + i, c, taps, out + i, count - i);
+  }
+
+  __attribute__((target("avx2,fma")))
+  static void kernelAvx2(const float *q, const float *c, int taps, float *out, int count)
+  {
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+      __m256 sum = _mm256_setzero_ps();
+      for (int j = 0; j < taps; j++)
+      {
+        __m256 x = _mm256_add_ps(_mm256_loadu_ps(q + i + j), _mm256_loadu_ps(q + i - 1 - j));
+        sum = _mm256_fmadd_ps(_mm256_set1_ps(c[j]), x, sum);
+      }
+      _mm256_storeu_ps(out + i, sum);
+    }
+    kernelPlain(q + i, c, taps, out + i, count - i);
+  }
+#endif
+
+  static Kernel selectKernel()
+  {
+#ifdef HALFBAND_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+      return kernelAvx2;
+    }
+    if (__builtin_cpu_supports("sse"))
+    {
+      return kernelSse;
+    }
+#endif
+    return kernelPlain;
+  }
+
+  // Kaiser windowed sinc, 'taps' nonzero coefficients on one
+  // side of the center, scaled to the DC gain 'gain'.
+  // Stopband attenuation is about 80 dB, longer filters
+  // have narrower transition bands around a quarter
+  // of the high sample rate.
+  static void design(float *c, int taps, double gain)
+  {
+    const double pi = 3.14159265358979323846;
+    const double beta = 8.0;
+    double sum = 0.0;
+
+    for (int j = 0; j < taps; j++)
+    {
+      double n = 2 * j + 1;
+      double x = n / (2 * taps);
+      double h = sin(pi * n / 2) / (pi * n) * besselI0(beta * sqrt(1.0 - x * x));
+      c[j] = h;
+      sum += h;
+    }
+
+    // Side taps of a halfband lowpass add up to 1/4 of its DC gain
+    for (int j = 0; j < taps; j++)
+    {
+      c[j] = c[j] * gain / (4 * sum);
+    }
+  }
+
+private:
+
+  static double besselI0(double x)
+  {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; term > 1e-12 * sum; k++)
+    {
+      term *= (x / (2 * k)) * (x / (2 * k));
+      sum += term;
+    }
+    return sum;
+  }
+};
+
+// Doubles the sample rate, delays by latency() output samples
+class HalfbandUp
+{
+public:
+
+  HalfbandUp() {}
+
+  HalfbandUp(const HalfbandUp&) = delete;
+  HalfbandUp& operator=(const HalfbandUp&) = delete;
+
+  // 'maxCount' - most input samples passed to process().
+  // Allocates memory, must not be called from the audio thread.
+  bool setup(int taps, int maxCount)
+  {
+    this->taps = taps;
+    kernel = Halfband::selectKernel();
+
+    if (!coefs.allocate(taps) || !line.allocate(2 * taps - 1 + maxCount) ||
+        !sums.allocate(maxCount))
+    {
+      return false;
+    }
+
+    // Zero stuffing halves the gain
+    Halfband::design(coefs.data(), taps, 2.0);
+    return true;
+  }
+
+  int latency() const
+  {
+    return 2 * taps - 1;
+  }
+
+  void reset()
+  {
+    memset(line.data(), 0, line.size() * sizeof(float));
+  }
+
+  // Writes 2 * 'count' samples to 'output',
+  // which must not overlap 'input'
+  void process(const float *input, float *output, int count)
+  {
+    // Last 2 * taps - 1 inputs are kept before the new ones
+    memcpy(line.data() + 2 * taps - 1, input, count * sizeof(float));
+
+    float *center = line.data() + taps;
+    kernel(center, coefs.data(), taps, sums.data(), count);
+
+    for (int i = 0; i < count; i++)
+    {
+      output[2 * i] = sums[i];
+      output[2 * i + 1] = center[i];
+    }
+
+    memmove(line.data(), line.data() + count, (2 * taps - 1) * sizeof(float));
+  }
+
+private:
+  int taps = 0;
+  Halfband::Kernel kernel = Halfband::kernelPlain;
+
+  AlignedBuffer<float> coefs;
+  AlignedBuffer<float> line;
+  AlignedBuffer<float> sums;
+};
+
+// Halves the sample rate, delays by latency() input samples.
+// 'delayed' adds one more input sample of delay, so that
+// cascades can keep their total delay a whole number of samples.
+class HalfbandDown
+{
+public:
+
+  HalfbandDown() {}
+
+  HalfbandDown(const HalfbandDown&) = delete;
+  HalfbandDown& operator=(const HalfbandDown&) = delete;
+
+  // 'maxCount' - most output samples asked from process().
+  // Allocates memory, must not be called from the audio thread.
+  bool setup(int taps, int maxCount, bool delayed)
+  {
+    this->taps = taps;
+    this->delayed = delayed;
+    kernel = Halfband::selectKernel();
+
+    if (!coefs.allocate(taps) || !even.allocate(2 * taps - 1 + maxCount) ||
+        !odd.allocate(taps + maxCount))
+    {
+      return false;
+    }
+
+    Halfband::design(coefs.data(), taps, 1.0);
+    reset();
+    return true;
+  }
+
+  int latency() const
+  {
+    return 2 * taps - 1 + (delayed ? 1 : 0);
+  }
+
+  void reset()
+  {
+    memset(even.data(), 0, even.size() * sizeof(float));
+    memset(odd.data(), 0, odd.size() * sizeof(float));
+    carry = 0.0f;
+  }
+
+  // Reads 2 * 'count' samples of 'input', which
+  // must not overlap 'output'
+  void process(const float *input, float *output, int count)
+  {
+    // Inputs are split into the polyphase branches,
+    // each keeps the history its filter needs
+    float *evenInput = even.data() + 2 * taps - 1;
+    float *oddInput = odd.data() + taps;
+
+    if (delayed)
+    {
+      evenInput[0] = carry;
+      for (int i = 1; i < count; i++)
+      {
+        evenInput[i] = input[2 * i - 1];
+      }
+      for (int i = 0; i < count; i++)
+      {
+        oddInput[i] = input[2 * i];
+      }
+      carry = input[2 * count - 1];
+    }
+    else
+    {
+      for (int i = 0; i < count; i++)
+      {
+        evenInput[i] = input[2 * i];
+        oddInput[i] = input[2 * i + 1];
+      }
+    }
+
+    kernel(even.data() + taps, coefs.data(), taps, output, count);
+
+    for (int i = 0; i < count; i++)
+    {
+      output[i] += 0.5f * odd[i];
+    }
+
+    memmove(even.data(), even.data() + count, (2 * taps - 1) * sizeof(float));
+    memmove(odd.data(), odd.data() + count, taps * sizeof(float));
+  }
+
+private:
+  int taps = 0;
+  bool delayed = false;
+  float carry = 0.0f;
+  Halfband::Kernel kernel = Halfband::kernelPlain;
+
+  AlignedBuffer<float> coefs;
+  AlignedBuffer<float> even;
+  AlignedBuffer<float> odd;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef OVERSAMPLER_H
+#define OVERSAMPLER_H
+
+#include <algorithm>
+
+#include "alignedbuffer.h"
+#include "sampleconvert.h"
+#include "halfband.h"
+
+// Runs mono processing at a multiple of the host rate.
+//
+// The rate is doubled by a cascade of halfband stages, one
+// for each factor of two, and halved by the same stages in
+// reverse. The outer stage has the steepest filters, inner
+// stages only have to reject images far above the host band
+// and get shorter ones. Every block gives exactly 'count'
+// output samples, delayed by latency() samples.
+class Oversampler
+{
+public:
+
+  enum
+  {
+    kMaxFactor = 8,
+    kMaxStages = 3,
+
+    // Taps per side of the outer halfband filters,
+    // half of their length in host rate samples.
+    // Longer filters have steeper slopes and more latency.
+    kRealtimeFilter = 16,
+    kOfflineFilter = 48,
+
+    // Shortest inner stage filter
+    kInnerFilter = 8
+  };
+
+  Oversampler() {}
+
+  Oversampler(const Oversampler&) = delete;
+  Oversampler& operator=(const Oversampler&) = delete;
+
+  // 'factor' - 1 (off), 2, 4 or 8.
+  // 'maxBlock' - longest block passed to process().
+  // Allocates memory, must not be called from the audio thread.
+  bool setup(int factor, int filterLength, int maxBlock)
+  {
+    mFactor = 1;
+    mStages = 0;
+    mLatency = 0;
+
+    int stages = 0;
+    while (((1 << stages) < factor) && (stages < kMaxStages))
+    {
+      stages++;
+    }
+
+    if ((1 << stages) != factor)
+    {
+      return false;
+    }
+
+    if (!scratch.allocate(maxBlock))
+    {
+      return false;
+    }
+
+    // Delay of the inner stages, in samples of the current stage's
+    // high rate. A stage adds its up- and downsampler delays, the
+    // downsampler is delayed by one more sample when needed so that
+    // the sum halves to a whole number of its low rate samples.
+    int delay = 0;
+    for (int s = stages - 1; s >= 0; s--)
+    {
+      int taps = (s == 0) ? filterLength : std::max(filterLength / 4, (int)kInnerFilter);
+      bool odd = (delay % 2) != 0;
+
+      if (!up[s].setup(taps, maxBlock << s) ||
+          !down[s].setup(taps, maxBlock << s, odd) ||
+          !levels[s].allocate(maxBlock << (s + 1)))
+      {
+        return false;
+      }
+
+      delay = (up[s].latency() + delay + down[s].latency()) / 2;
+    }
+
+    mFactor = factor;
+    mStages = stages;
+    mLatency = delay;
+
+    reset();
+    return true;
+  }
+
+  int factor() const
+  {
+    return mFactor;
+  }
+
+  // In host rate samples
+  int latency() const
+  {
+    return mLatency;
+  }
+
+  // Fills filter histories with silence
+  void reset()
+  {
+    for (int s = 0; s < mStages; s++)
+    {
+      up[s].reset();
+      down[s].reset();
+    }
+  }
+
+  // Upsamples 'count' samples of 'input', calls 'process (float *data, int count)'
+  // with 'count * factor()' samples to be processed in place and downsamples
+  // the result to 'output'. 'input' and 'output' may be the same buffer.
+  template <typename InputType, typename OutputType, typename Process>
+  void process(InputType *input, OutputType *output, int count, Process &&process)
+  {
+    const float *data = convertSamples(input, scratch.data(), count);
+    for (int s = 0; s < mStages; s++)
+    {
+      up[s].process(data, levels[s].data(), count << s);
+      data = levels[s].data();
+    }
+
+    float *high = levels[mStages - 1].data();
+    process(high, count * mFactor);
+
+    // Each stage's output goes to the buffer of the stage
+    // outside it, its up path samples are consumed already
+    for (int s = mStages - 1; s > 0; s--)
+    {
+      down[s].process(levels[s].data(), levels[s - 1].data(), count << s);
+    }
+
+    float *downOutput = outputSamples(output, scratch.data());
+    down[0].process(levels[0].data(), downOutput, count);
+
+    storeSamples(downOutput, output, count);
+  }
+
+private:
+
+  HalfbandUp up[kMaxStages];
+  HalfbandDown down[kMaxStages];
+
+  // Output of up[s] and input of down[s], at 2^(s+1) times the host rate
+  AlignedBuffer<float> levels[kMaxStages];
+  AlignedBuffer<float> scratch;  // Host samples of other precision
+
+  int mFactor = 1;
+  int mStages = 0;
+  int mLatency = 0;
+};
+
+#endif
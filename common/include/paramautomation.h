@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef PARAM_AUTOMATION_H
+#define PARAM_AUTOMATION_H
+
+#include "pluginterfaces/vst/ivstparameterchanges.h"
+
+namespace Steinberg {
+namespace Vst {
+
+  // Sample accurate rendering of parameter automation.
+  //
+  // Parameter queues of one process() call are collected
+  // as lanes, then the block is rendered in sub-blocks split
+  // at the sample offsets of automation points. Between two
+  // points the value is ramped linearly and updated every
+  // kRampBlock samples. Sub-blocks are never shorter than
+  // kMinBlock samples, closer points share one step.
+  class ParamAutomation
+  {
+  public:
+
+    enum
+    {
+      kMaxLanes = 16,
+      kMinBlock = 16,
+      kRampBlock = 64
+    };
+
+    void clear()
+    {
+      numLanes = 0;
+    }
+
+    // startValue - normalized value reached at the end
+    // of the previous block, the first ramp starts from it.
+    void addQueue(IParamValueQueue *queue, ParamValue startValue)
+    {
+      if ((numLanes >= kMaxLanes) || (queue->getPointCount() <= 0))
+      {
+        return;
+      }
+
+      Lane &lane = lanes[numLanes++];
+      lane.queue = queue;
+      lane.id = queue->getParameterId();
+      lane.numPoints = queue->getPointCount();
+      lane.nextPoint = 0;
+      lane.prevOffset = 0;
+      lane.prevValue = startValue;
+      lane.applied = false;
+      loadNextPoint(lane);
+    }
+
+    int32 getLaneCount() const
+    {
+      return numLanes;
+    }
+
+    // Returns end of the sub-block which starts at 'pos'
+    int32 nextSplit(int32 pos, int32 numSamples)
+    {
+      int32 end = numSamples;
+
+      for (int32 i = 0; i < numLanes; i++)
+      {
+        Lane &lane = lanes[i];
+        advance(lane, pos);
+
+        if (lane.hasNext)
+        {
+          if (lane.nextOffset < end)
+          {
+            end = lane.nextOffset;
+          }
+          if ((lane.nextValue != lane.prevValue) && (pos + kRampBlock < end))
+          {
+            end = pos + kRampBlock;
+          }
+        }
+      }
+
+      if (end - pos < kMinBlock)
+      {
+        end = pos + kMinBlock;
+      }
+      if (end > numSamples)
+      {
+        end = numSamples;
+      }
+      return end;
+    }
+
+    // Calls setter(id, value) for every parameter whose value
+    // at sample 'offset' is not applied yet. The value used for
+    // a sub-block is the one reached at its end, so the last
+    // sub-block ends exactly on the last automation point.
+    template <typename Setter>
+    void apply(int32 offset, Setter setter)
+    {
+      for (int32 i = 0; i < numLanes; i++)
+      {
+        Lane &lane = lanes[i];
+        advance(lane, offset);
+
+        if (!lane.hasNext)
+        {
+          if (!lane.applied)
+          {
+            setter(lane.id, lane.prevValue);
+            lane.applied = true;
+          }
+        }
+        else
+        {
+          ParamValue value = lane.prevValue;
+          if (lane.nextOffset > lane.prevOffset)
+          {
+            value += (lane.nextValue - lane.prevValue) *
+              (ParamValue)(offset - lane.prevOffset) /
+              (ParamValue)(lane.nextOffset - lane.prevOffset);
+          }
+          setter(lane.id, value);
+        }
+      }
+    }
+
+  private:
+
+    struct Lane
+    {
+      IParamValueQueue *queue;
+      ParamID id;
+      int32 numPoints;
+      int32 nextPoint;
+      int32 prevOffset;
+      int32 nextOffset;
+      ParamValue prevValue;
+      ParamValue nextValue;
+      bool hasNext;
+      bool applied;
+    };
+
+    void loadNextPoint(Lane &lane)
+    {
+      lane.hasNext = false;
+      while (lane.nextPoint < lane.numPoints)
+      {
+        int32 sampleOffset;
+        ParamValue value;
+        if (lane.queue->getPoint(lane.nextPoint++, sampleOffset, value) == kResultTrue)
+        {
+          lane.nextOffset = sampleOffset;
+          lane.nextValue = value;
+          lane.hasNext = true;
+          break;
+        }
+      }
+    }
+
+    // Moves all points at or before 'offset' behind the lane
+    void advance(Lane &lane, int32 offset)
+    {
+      while (lane.hasNext && (lane.nextOffset <= offset))
+      {
+        lane.prevOffset = lane.nextOffset;
+        lane.prevValue = lane.nextValue;
+        loadNextPoint(lane);
+      }
+    }
+
+    Lane lanes[kMaxLanes];
+    int32 numLanes = 0;
+  };
+
+} // namespace Vst
+} // namespace Steinberg
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef SAMPLE_CONVERT_H
+#define SAMPLE_CONVERT_H
+
+#include <string.h>
+
+// Helpers for running code of one sample precision
+// (FAUST code, convolvers) on host buffers of another.
+// When both precisions are the same, host buffers are
+// used directly and nothing is copied.
+
+// Returns 'src' as 'To' samples, converted into 'scratch' if needed
+template <typename To, typename From>
+inline To* convertSamples (From *src, To *scratch, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    scratch[i] = (To)src[i];
+  }
+  return scratch;
+}
+
+template <typename T>
+inline T* convertSamples (T *src, T *, int)
+{
+  return src;
+}
+
+// Returns where 'To' code should write output meant for 'dst'
+template <typename To, typename From>
+inline To* outputSamples (From *, To *scratch)
+{
+  return scratch;
+}
+
+template <typename T>
+inline T* outputSamples (T *dst, T *)
+{
+  return dst;
+}
+
+// Stores output written by 'From' code to 'dst'
+template <typename From, typename To>
+inline void storeSamples (From *src, To *dst, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    dst[i] = (To)src[i];
+  }
+}
+
+template <typename T>
+inline void storeSamples (T *src, T *dst, int count)
+{
+  if (src != dst)
+  {
+    memcpy (dst, src, count * sizeof (T));
+  }
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef SETTINGS_MESSAGE_H
+#define SETTINGS_MESSAGE_H
+
+#include "public.sdk/source/vst/vstcomponentbase.h"
+
+namespace Steinberg {
+namespace Vst {
+
+  // Settings applied by the processor only in setActive()
+  // (oversampling, zero latency...) change the latency.
+  // The controller does not restart the component itself,
+  // it sends the new value to the processor as a "Setting"
+  // message. The processor stores it and answers "Restart"
+  // when it differs from the active setup, so the host
+  // asks for the latency once the processor has the value.
+
+  inline void sendSetting (ComponentBase *component, ParamID id, ParamValue value)
+  {
+    IPtr<IMessage> message = owned (component->allocateMessage ());
+    if (message)
+    {
+      message->setMessageID ("Setting");
+      message->getAttributes ()->setInt ("id", id);
+      message->getAttributes ()->setFloat ("value", value);
+      component->sendMessage (message);
+    }
+  }
+
+  inline bool readSetting (IMessage *message, ParamID &id, ParamValue &value)
+  {
+    if (!message || !FIDStringsEqual (message->getMessageID (), "Setting"))
+      return false;
+
+    int64 intId = 0;
+    double doubleValue = 0;
+    if ((message->getAttributes ()->getInt ("id", intId) != kResultOk) ||
+        (message->getAttributes ()->getFloat ("value", doubleValue) != kResultOk))
+      return false;
+
+    id = (ParamID)intId;
+    value = doubleValue;
+    return true;
+  }
+
+  inline void sendRestart (ComponentBase *component)
+  {
+    IPtr<IMessage> message = owned (component->allocateMessage ());
+    if (message)
+    {
+      message->setMessageID ("Restart");
+      component->sendMessage (message);
+    }
+  }
+
+  inline bool isRestart (IMessage *message)
+  {
+    return message && FIDStringsEqual (message->getMessageID (), "Restart");
+  }
+
+} // Vst
+} // Steinberg
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef SILENCE_DETECTOR_H
+#define SILENCE_DETECTOR_H
+
+#include "pluginterfaces/vst/ivstaudioprocessor.h"
+
+#include <string.h>
+
+namespace Steinberg {
+namespace Vst {
+
+  // Tracks how long the input bus has been silent.
+  //
+  // Input is silent when the host set silence flags for all
+  // its channels or when all samples are below kThreshold.
+  // When silence lasts longer than the tail of the processing
+  // chain, the output is silent too and the block may be
+  // skipped. Tail is set in samples.
+  class SilenceDetector
+  {
+  public:
+
+    static constexpr float kThreshold = 1e-6f;   // -120 dB
+
+    void setTailSamples(int32 samples)
+    {
+      tailSamples = samples;
+    }
+
+    int32 getTailSamples() const
+    {
+      return tailSamples;
+    }
+
+    // Forgets the silence counted so far
+    void reset()
+    {
+      silentSamples = 0;
+      sleeping = false;
+      wasSleeping = false;
+    }
+
+    // Must be called once per block before processing.
+    // Returns true when the block can be skipped
+    // and the output filled with silence.
+    bool update(const AudioBusBuffers &input, int32 numSamples,
+                int32 sampleSize = kSample32)
+    {
+      bool silent = isSilent(input, numSamples, sampleSize);
+
+      wasSleeping = sleeping;
+      sleeping = silent && (silentSamples >= tailSamples);
+
+      if (silent)
+      {
+        if (silentSamples < tailSamples)
+        {
+          silentSamples += numSamples;
+        }
+      }
+      else
+      {
+        silentSamples = 0;
+      }
+
+      return sleeping;
+    }
+
+    // True for the first processed block after skipped ones
+    bool wokeUp() const
+    {
+      return wasSleeping && !sleeping;
+    }
+
+    // 'sampleSize' - symbolic sample size of the bus buffers
+    static bool isSilent(const AudioBusBuffers &input, int32 numSamples,
+                         int32 sampleSize = kSample32)
+    {
+      uint64 allChannels = (input.numChannels < 64) ?
+        ((uint64)1 << input.numChannels) - 1 : ~(uint64)0;
+
+      if ((input.silenceFlags & allChannels) == allChannels)
+      {
+        return true;
+      }
+
+      for (int32 c = 0; c < input.numChannels; c++)
+      {
+        bool silent = (sampleSize == kSample64) ?
+          isSilent(input.channelBuffers64[c], numSamples) :
+          isSilent(input.channelBuffers32[c], numSamples);
+
+        if (!silent)
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // Silences the whole bus and sets its silence flags
+    static void silence(AudioBusBuffers &output, int32 numSamples,
+                        int32 sampleSize = kSample32)
+    {
+      for (int32 c = 0; c < output.numChannels; c++)
+      {
+        if (sampleSize == kSample64)
+        {
+          memset(output.channelBuffers64[c], 0, numSamples * sizeof(Sample64));
+        }
+        else
+        {
+          memset(output.channelBuffers32[c], 0, numSamples * sizeof(Sample32));
+        }
+      }
+      output.silenceFlags = (output.numChannels < 64) ?
+        ((uint64)1 << output.numChannels) - 1 : ~(uint64)0;
+    }
+
+  private:
+
+    template <typename SampleType>
+    static bool isSilent(const SampleType *buf, int32 numSamples)
+    {
+      for (int32 i = 0; i < numSamples; i++)
+      {
+        if ((buf[i] > kThreshold) || (buf[i] < -kThreshold))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    int32 tailSamples = 0;
+    int32 silentSamples = 0;
+    bool sleeping = false;
+    bool wasSleeping = false;
+  };
+
+} // namespace Vst
+} // namespace Steinberg
+
+#endif
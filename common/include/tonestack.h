@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+
+#ifndef TONESTACK_H
+#define TONESTACK_H
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TONESTACK_SSE
+#include <emmintrin.h>
+#endif
+
+// Bands of Tonestack
+enum TonestackBand
+{
+  kTonestackLow,
+  kTonestackMiddle,
+  kTonestackHigh,
+  kTonestackBands
+};
+
+// Bass, middle and treble bands of tubeAmp and the pedals.
+//
+// Each band is a peaking second order section with the response
+// of FAUST fi.peak_eq, run in transposed direct form II. The
+// sections are an array of lanes, one lane per section, and are
+// evaluated as a pipeline: in one step section k filters the
+// sample that section k - 1 gave in the previous step, so all
+// of them are updated by the same vector operations. Lanes are
+// skewed by one sample each, steps at the ends of a block update
+// only the sections that have a sample, so there is no latency.
+//
+// Coefficients are designed when a band or the sample rate
+// changes, not in process().
+template <typename T>
+class Tonestack
+{
+public:
+
+  Tonestack()
+  {
+    for (int k = 0; k < kTonestackBands; k++)
+    {
+      gain[k] = 0.0;
+      freq[k] = 1000.0;
+      width[k] = 1000.0;
+    }
+    sampleRate = 48000.0;
+    changed = true;
+    reset();
+  }
+
+  void setRate(double rate)
+  {
+    if (rate != sampleRate)
+    {
+      sampleRate = rate;
+      changed = true;
+    }
+  }
+
+  // Gain at the center of the band in dB
+  void setGain(int band, double value)
+  {
+    if (value != gain[band])
+    {
+      gain[band] = value;
+      changed = true;
+    }
+  }
+
+  // Center frequency and bandwidth in Hz
+  void setBand(int band, double center, double bandwidth)
+  {
+    if ((center != freq[band]) || (bandwidth != width[band]))
+    {
+      freq[band] = center;
+      width[band] = bandwidth;
+      changed = true;
+    }
+  }
+
+  void reset()
+  {
+    memset(s1, 0, sizeof(s1));
+    memset(s2, 0, sizeof(s2));
+    memset(y, 0, sizeof(y));
+  }
+
+  // Filters 'data' in place
+  void process(T *data, int count)
+  {
+    if (changed)
+    {
+      design();
+    }
+
+    // Step m gives section k sample m - k
+    const int steps = count + kTonestackBands - 1;
+    int m = 0;
+    for (; (m < kTonestackBands - 1) && (m < steps); m++)
+    {
+      partialStep(data, m, count);
+    }
+    m = fullSteps(data, m, count);
+    for (; m < steps; m++)
+    {
+      partialStep(data, m, count);
+    }
+  }
+
+private:
+
+  // The last lane is a silent section with zero coefficients
+  enum { kLanes = 4 };
+
+  // Prewarped bilinear transform of the analog prototype
+  // with unit center frequency, as in fi.peak_eq and fi.tf2s
+  void design()
+  {
+    const double pi = 3.14159265358979323846;
+
+    for (int k = 0; k < kLanes; k++)
+    {
+      b0[k] = b1[k] = b2[k] = a1[k] = a2[k] = 0;
+    }
+
+    for (int k = 0; k < kTonestackBands; k++)
+    {
+      double wx = 2.0 * pi * freq[k];
+      double bw = width[k] / (sampleRate * sin(wx / sampleRate));
+      double g = pow(10.0, fabs(gain[k]) / 20.0);
+
+      // Pole dominates bandwidth of a boost, zero of a cut
+      double a1p = pi * bw;
+      double b1p = g * a1p;
+      double b1s = (gain[k] > 0) ? b1p : a1p;
+      double a1s = (gain[k] > 0) ? a1p : b1p;
+
+      double c = 1.0 / tan(0.5 * wx / sampleRate);
+      double csq = c * c;
+      double d = 1.0 + a1s * c + csq;
+
+      b0[k] = (1.0 + b1s * c + csq) / d;
+      b1[k] = 2.0 * (1.0 - csq) / d;
+      b2[k] = (1.0 - b1s * c + csq) / d;
+      a1[k] = b1[k];
+      a2[k] = (1.0 - a1s * c + csq) / d;
+    }
+
+    changed = false;
+  }
+
+  // Step at the ends of a block, sections
+  // without a sample keep their state
+  void partialStep(T *data, int m, int count)
+  {
+    T x[kLanes];
+    x[0] = (m < count) ? data[m] : 0;
+    for (int k = 1; k < kLanes; k++)
+    {
+      x[k] = y[k - 1];
+    }
+
+    for (int k = 0; k < kTonestackBands; k++)
+    {
+      if ((m - k >= 0) && (m - k < count))
+      {
+        y[k] = b0[k] * x[k] + s1[k];
+        s1[k] = b1[k] * x[k] - a1[k] * y[k] + s2[k];
+        s2[k] = b2[k] * x[k] - a2[k] * y[k];
+      }
+    }
+
+    if (m - (kTonestackBands - 1) >= 0)
+    {
+      data[m - (kTonestackBands - 1)] = y[kTonestackBands - 1];
+    }
+  }
+
+  // Steps in which all sections have a sample, returns
+  // the first step left
+  int fullSteps(T *data, int m, int count)
+  {
+    for (; m < count; m++)
+    {
+      T x[kLanes];
+      x[0] = data[m];
+      for (int k = 1; k < kLanes; k++)
+      {
+        x[k] = y[k - 1];
+      }
+
+      for (int k = 0; k < kLanes; k++)
+      {
+        y[k] = b0[k] * x[k] + s1[k];
+        s1[k] = b1[k] * x[k] - a1[k] * y[k] + s2[k];
+        s2[k] = b2[k] * x[k] - a2[k] * y[k];
+      }
+
+      data[m - (kTonestackBands - 1)] = y[kTonestackBands - 1];
+    }
+    return m;
+  }
+
+  T b0[kLanes];
+  T b1[kLanes];
+  T b2[kLanes];
+  T a1[kLanes];
+  T a2[kLanes];
+
+  // States of the sections and their outputs of the last step
+  T s1[kLanes];
+  T s2[kLanes];
+  T y[kLanes];
+
+  double gain[kTonestackBands];
+  double freq[kTonestackBands];
+  double width[kTonestackBands];
+  double sampleRate;
+  bool changed;
+};
+
+#ifdef TONESTACK_SSE
+// Lanes of a float tonestack are one SSE register,
+// the pipeline shift is a byte shift of the outputs
+template <>
+inline int Tonestack<float>::fullSteps(float *data, int m, int count)
+{
+  if (m >= count)
+  {
+    return m;
+  }
+
+  __m128 vb0 = _mm_loadu_ps(b0);
+  __m128 vb1 = _mm_loadu_ps(b1);
+  __m128 vb2 = _mm_loadu_ps(b2);
+  __m128 va1 = _mm_loadu_ps(a1);
+  __m128 va2 = _mm_loadu_ps(a2);
+  __m128 vs1 = _mm_loadu_ps(s1);
+  __m128 vs2 = _mm_loadu_ps(s2);
+  __m128 vy = _mm_loadu_ps(y);
+
+  for (; m < count; m++)
+  {
+    __m128 x = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(vy), 4));
+    x = _mm_move_ss(x, _mm_set_ss(data[m]));
+
+    vy = _mm_add_ps(_mm_mul_ps(vb0, x), vs1);
+    vs1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(vb1, x), _mm_mul_ps(va1, vy)), vs2);
+    vs2 = _mm_sub_ps(_mm_mul_ps(vb2, x), _mm_mul_ps(va2, vy));
+
+    data[m - (kTonestackBands - 1)] =
+      _mm_cvtss_f32(_mm_shuffle_ps(vy, vy, _MM_SHUFFLE(2, 2, 2, 2)));
+  }
+
+  _mm_storeu_ps(s1, vs1);
+  _mm_storeu_ps(s2, vs2);
+  _mm_storeu_ps(y, vy);
+  return m;
+}
+#endif
+
+#endif
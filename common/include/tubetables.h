@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef TUBE_TABLES_H
+#define TUBE_TABLES_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Lookup tables for the fast FAUST code of tubeAmp,
+// called through ffunction() from kpp_tube.lib.
+//
+// Saturating part of tube() is U + d / (1 + K*d) for d = x - U > 0.
+// With u = K*d it is U + h(u) / K, h(u) = u / (1 + u), so one
+// table of h(u) serves all profiles and is never rebuilt.
+//
+// Tables are piecewise linear with knots spaced evenly inside each
+// octave of the argument. Position in a table is taken from the
+// exponent and mantissa bits of the argument, no division or
+// logarithm is needed. Tables are built at compile time.
+//
+// Maximum absolute error, float, double and long double arguments,
+// checked against the exact form by common/tools/tubetablescheck.cpp:
+//   kpp_tube_curve - 9.0e-6, output of tube() errs by this / Kreg
+//   kpp_recip      - 3.9e-6 for arguments in [1, 4]
+
+// Table of 'Function' with 2^Bits segments per octave
+// from 2^MinExp to 2^(MinExp + Octaves)
+template <typename Function, int MinExp, int Octaves, int Bits>
+struct OctaveTable
+{
+  enum
+  {
+    kSize = (Octaves << Bits) + 1,
+    kShift = 23 - Bits
+  };
+
+  float value[kSize];
+
+  constexpr OctaveTable() : value()
+  {
+    for (int i = 0; i < kSize; i++)
+    {
+      double x = 1.0 + (double)(i & ((1 << Bits) - 1)) / (1 << Bits);
+      for (int e = 0; e < (i >> Bits) + MinExp; e++)
+      {
+        x *= 2.0;
+      }
+      for (int e = 0; e > (i >> Bits) + MinExp; e--)
+      {
+        x *= 0.5;
+      }
+      value[i] = (float)Function::exact(x);
+    }
+  }
+
+  // 'x' must lie in [2^MinExp, 2^(MinExp + Octaves)],
+  // the upper end gives the last knot
+  template <typename T>
+  T lookup(T x) const
+  {
+    float f = (float)x;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+
+    int pos = (int)(bits >> kShift) - ((127 + MinExp) << Bits);
+    if (pos >= kSize - 1)
+    {
+      // Double argument just below the end rounded up to it
+      return value[kSize - 1];
+    }
+
+    T frac = (T)(bits & ((1u << kShift) - 1)) * ((T)1.0 / (T)(1u << kShift));
+
+    return value[pos] + frac * (value[pos + 1] - value[pos]);
+  }
+};
+
+struct TubeCurve
+{
+  static constexpr double exact(double u)
+  {
+    return u / (1.0 + u);
+  }
+
+  // Below the table h(u) = u - u^2 + O(u^3),
+  // above it h(u) = 1 - O(1/u)
+  template <typename T>
+  static T fast(T u)
+  {
+    static constexpr OctaveTable<TubeCurve, -8, 28, 6> table;
+
+    if (u <= (T)0.0)
+    {
+      return u;
+    }
+    if (u < (T)(1.0 / 256.0))
+    {
+      return u - u * u;
+    }
+    if (u >= (T)1048576.0)
+    {
+      return (T)1.0;
+    }
+    return table.lookup(u);
+  }
+};
+
+struct Reciprocal
+{
+  static constexpr double exact(double x)
+  {
+    return 1.0 / x;
+  }
+
+  // Arguments are clamped to [1, 4]
+  template <typename T>
+  static T fast(T x)
+  {
+    static constexpr OctaveTable<Reciprocal, 0, 2, 8> table;
+
+    if (x < (T)1.0)
+    {
+      x = (T)1.0;
+    }
+    if (x > (T)4.0)
+    {
+      x = (T)4.0;
+    }
+    return table.lookup(x);
+  }
+};
+
+// Names used by ffunction(), for float, double and quad FAUST code
+inline float kpp_tube_curvef(float u)
+{
+  return TubeCurve::fast(u);
+}
+
+inline double kpp_tube_curve(double u)
+{
+  return TubeCurve::fast(u);
+}
+
+inline long double kpp_tube_curvel(long double u)
+{
+  return TubeCurve::fast(u);
+}
+
+inline float kpp_recipf(float x)
+{
+  return Reciprocal::fast(x);
+}
+
+inline double kpp_recip(double x)
+{
+  return Reciprocal::fast(x);
+}
+
+inline long double kpp_recipl(long double x)
+{
+  return Reciprocal::fast(x);
+}
+
+#endif
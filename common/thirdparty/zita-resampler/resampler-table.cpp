@@ -78,18 +78,27 @@ Resampler_table::~Resampler_table(void)
 
 Resampler_table* Resampler_table::create(double fr, unsigned int hl, unsigned int np)
 {
-    Resampler_table* P;
+    Resampler_table* P, * Q;
 
     _mutex.lock();
     P = _list;
+    Q = 0;
     while (P)
     {
         if ((fr >= P->_fr * 0.999) && (fr <= P->_fr * 1.001) && (hl == P->_hl) && (np == P->_np))
         {
+            // Most recently used tables are kept in front
+            if (Q)
+            {
+                Q->_next = P->_next;
+                P->_next = _list;
+                _list = P;
+            }
             P->_refc++;
             _mutex.unlock();
             return P;
         }
+        Q = P;
         P = P->_next;
     }
     P = new Resampler_table(fr, hl, np);
@@ -111,26 +120,73 @@ void Resampler_table::destroy(Resampler_table* T)
         T->_refc--;
         if (T->_refc == 0)
         {
+            // Kept as the most recently used
             P = _list;
             Q = 0;
             while (P)
             {
                 if (P == T)
                 {
-                    if (Q) Q->_next = T->_next;
-                    else      _list = T->_next;
+                    if (Q)
+                    {
+                        Q->_next = T->_next;
+                        T->_next = _list;
+                        _list = T;
+                    }
                     break;
                 }
                 Q = P;
                 P = P->_next;
             }
-            delete T;
+            prune(MAX_UNUSED);
+        }
+    }
+    _mutex.unlock();
+}
+
+
+// Deletes unused tables after the first 'keep' of them.
+// Called with the mutex locked.
+void Resampler_table::prune(unsigned int keep)
+{
+    Resampler_table* P, * Q;
+    unsigned int     n;
+
+    P = _list;
+    Q = 0;
+    n = 0;
+    while (P)
+    {
+        if ((P->_refc == 0) && (++n > keep))
+        {
+            if (Q) Q->_next = P->_next;
+            else      _list = P->_next;
+            delete P;
+            P = Q ? Q->_next : _list;
+            continue;
         }
+        Q = P;
+        P = P->_next;
     }
+}
+
+
+void Resampler_table::purge(void)
+{
+    _mutex.lock();
+    prune(0);
     _mutex.unlock();
 }
 
 
+// Frees the kept tables when the program ends or the plugin is unloaded.
+// Defined after the mutex, so it is destroyed first.
+static struct Resampler_cleanup
+{
+    ~Resampler_cleanup(void) { Resampler_table::purge(); }
+} resampler_cleanup;
+
+
 void Resampler_table::print_list(void)
 {
     Resampler_table* P;
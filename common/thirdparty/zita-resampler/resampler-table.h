@@ -54,6 +54,9 @@ public:
 
     static void print_list (void);
 
+    // Deletes all tables not in use
+    static void purge (void);
+
 private:
 
     Resampler_table (double fr, unsigned int hl, unsigned int np);
@@ -69,8 +72,13 @@ private:
     unsigned int         _hl;
     unsigned int         _np;
 
+    // Released tables are kept for later setups, at most
+    // MAX_UNUSED of them, the least recently used go first
+    enum { MAX_UNUSED = 8 };
+
     static Resampler_table *create (double fr, unsigned int hl, unsigned int np);
     static void destroy (Resampler_table *T);
+    static void prune (unsigned int keep);
 
     static Resampler_table  *_list;
     static Resampler_mutex   _mutex;
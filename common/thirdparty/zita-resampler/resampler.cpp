@@ -0,0 +1,408 @@
+#include "resampler.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RESAMPLER_X86
+#include <immintrin.h>
+#endif
+
+
+// Vector kernels of process(). Each gives one output sample per channel,
+//
+//   out [c] = sum (q1 [i * N + c] * c1 [i] + q2 [-(i + 1) * N + c] * c2 [i]), i < hl
+//
+// for N channels interleaved. Taps go across the vector lanes, samples of
+// both channels of a tap lie next to each other and are loaded together.
+// The q2 half runs backwards, its lanes are reordered instead of loading
+// samples one by one. Accumulators start from 1e-20 to avoid denormals,
+// as in the plain loop.
+
+bool Resampler::use_simd = true;
+
+#ifdef RESAMPLER_X86
+
+__attribute__((target("sse")))
+static void kernel_mono_sse(const float *q1, const float *q2,
+                            const float *c1, const float *c2,
+                            unsigned int hl, float *out)
+{
+    unsigned int i;
+    __m128 s = _mm_set1_ps(1e-20f);
+    float r [4];
+
+    for (i = 0; i + 4 <= hl; i += 4)
+    {
+        __m128 x1 = _mm_loadu_ps(q1 + i);
+        __m128 x2 = _mm_loadu_ps(q2 - i - 4);
+        x2 = _mm_shuffle_ps(x2, x2, _MM_SHUFFLE(0, 1, 2, 3));
+        s = _mm_add_ps(s, _mm_mul_ps(x1, _mm_loadu_ps(c1 + i)));
+        s = _mm_add_ps(s, _mm_mul_ps(x2, _mm_loadu_ps(c2 + i)));
+    }
+    _mm_storeu_ps(r, s);
+    float t = (r [0] + r [1]) + (r [2] + r [3]);
+    for (; i < hl; i++) t += q1 [i] * c1 [i] + q2 [-(int)i - 1] * c2 [i];
+    out [0] = t - 4e-20f;
+}
+
+__attribute__((target("sse")))
+static void kernel_stereo_sse(const float *q1, const float *q2,
+                              const float *c1, const float *c2,
+                              unsigned int hl, float *out)
+{
+    unsigned int i;
+    __m128 s = _mm_set1_ps(1e-20f);
+    float r [4];
+
+    for (i = 0; i + 4 <= hl; i += 4)
+    {
+        // Lanes L R L R of taps i, i + 1 and i + 2, i + 3
+        __m128 c = _mm_loadu_ps(c1 + i);
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(q1 + 2 * i), _mm_unpacklo_ps(c, c)));
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(q1 + 2 * i + 4), _mm_unpackhi_ps(c, c)));
+
+        // Taps i + 1, i and i + 3, i + 2
+        __m128 d = _mm_loadu_ps(c2 + i);
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(q2 - 2 * i - 4),
+                                     _mm_shuffle_ps(d, d, _MM_SHUFFLE(0, 0, 1, 1))));
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(q2 - 2 * i - 8),
+                                     _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 2, 3, 3))));
+    }
+    _mm_storeu_ps(r, s);
+    float t0 = r [0] + r [2];
+    float t1 = r [1] + r [3];
+    for (; i < hl; i++)
+    {
+        t0 += q1 [2 * i] * c1 [i] + q2 [-2 * (int)i - 2] * c2 [i];
+        t1 += q1 [2 * i + 1] * c1 [i] + q2 [-2 * (int)i - 1] * c2 [i];
+    }
+    out [0] = t0 - 2e-20f;
+    out [1] = t1 - 2e-20f;
+}
+
+__attribute__((target("avx2,fma")))
+static void kernel_mono_avx2(const float *q1, const float *q2,
+                             const float *c1, const float *c2,
+                             unsigned int hl, float *out)
+{
+    unsigned int i;
+    const __m256i rev = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 s1 = _mm256_set1_ps(0.5e-20f);
+    __m256 s2 = _mm256_set1_ps(0.5e-20f);
+    float r [8];
+
+    for (i = 0; i + 8 <= hl; i += 8)
+    {
+        __m256 x2 = _mm256_permutevar8x32_ps(_mm256_loadu_ps(q2 - i - 8), rev);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(q1 + i), _mm256_loadu_ps(c1 + i), s1);
+        s2 = _mm256_fmadd_ps(x2, _mm256_loadu_ps(c2 + i), s2);
+    }
+    _mm256_storeu_ps(r, _mm256_add_ps(s1, s2));
+    float t = ((r [0] + r [1]) + (r [2] + r [3])) + ((r [4] + r [5]) + (r [6] + r [7]));
+    for (; i < hl; i++) t += q1 [i] * c1 [i] + q2 [-(int)i - 1] * c2 [i];
+    out [0] = t - 8e-20f;
+}
+
+__attribute__((target("avx2,fma")))
+static void kernel_stereo_avx2(const float *q1, const float *q2,
+                               const float *c1, const float *c2,
+                               unsigned int hl, float *out)
+{
+    unsigned int i;
+    const __m256i fwd = _mm256_set_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+    const __m256i rev = _mm256_set_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    __m256 s1 = _mm256_set1_ps(0.5e-20f);
+    __m256 s2 = _mm256_set1_ps(0.5e-20f);
+    float r [8];
+
+    for (i = 0; i + 4 <= hl; i += 4)
+    {
+        // Lanes L R of taps i ... i + 3, and of taps i + 3 ... i
+        __m256 c = _mm256_castps128_ps256(_mm_loadu_ps(c1 + i));
+        __m256 d = _mm256_castps128_ps256(_mm_loadu_ps(c2 + i));
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(q1 + 2 * i),
+                             _mm256_permutevar8x32_ps(c, fwd), s1);
+        s2 = _mm256_fmadd_ps(_mm256_loadu_ps(q2 - 2 * i - 8),
+                             _mm256_permutevar8x32_ps(d, rev), s2);
+    }
+    _mm256_storeu_ps(r, _mm256_add_ps(s1, s2));
+    float t0 = (r [0] + r [2]) + (r [4] + r [6]);
+    float t1 = (r [1] + r [3]) + (r [5] + r [7]);
+    for (; i < hl; i++)
+    {
+        t0 += q1 [2 * i] * c1 [i] + q2 [-2 * (int)i - 2] * c2 [i];
+        t1 += q1 [2 * i + 1] * c1 [i] + q2 [-2 * (int)i - 1] * c2 [i];
+    }
+    out [0] = t0 - 4e-20f;
+    out [1] = t1 - 4e-20f;
+}
+
+#endif
+
+
+static Resampler_kernel select_kernel(unsigned int nchan)
+{
+#ifdef RESAMPLER_X86
+    if (Resampler::use_simd && (nchan <= 2))
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return (nchan == 1) ? kernel_mono_avx2 : kernel_stereo_avx2;
+        }
+        if (__builtin_cpu_supports("sse"))
+        {
+            return (nchan == 1) ? kernel_mono_sse : kernel_stereo_sse;
+        }
+    }
+#endif
+    return 0;
+}
+
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    if (a == 0) return b;
+    if (b == 0) return a;
+    while (1)
+    {
+        if (a > b)
+        {
+            a = a % b;
+            if (a == 0) return b;
+            if (a == 1) return 1;
+        }
+        else
+        {
+            b = b % a;
+            if (b == 0) return a;
+            if (b == 1) return 1;
+        }
+    }
+    return 1;
+}
+
+
+Resampler::Resampler(void) :
+    _table(0),
+    _nchan(0),
+    _buff(0),
+    _kernel(0)
+{
+    reset();
+}
+
+
+Resampler::~Resampler(void)
+{
+    clear();
+}
+
+
+int Resampler::setup(unsigned int fs_inp,
+    unsigned int fs_out,
+    unsigned int nchan,
+    unsigned int hlen)
+{
+    if ((hlen < 8) || (hlen > 96)) return 1;
+    return setup(fs_inp, fs_out, nchan, hlen, 1.0 - 2.6 / hlen);
+}
+
+
+int Resampler::setup(unsigned int fs_inp,
+    unsigned int fs_out,
+    unsigned int nchan,
+    unsigned int hlen,
+    double       frel)
+{
+    unsigned int       g, h, k, n, s;
+    double             r;
+    float* B = 0;
+    Resampler_table* T = 0;
+
+    k = s = 0;
+    if (fs_inp && fs_out && nchan)
+    {
+        r = (double)fs_out / (double)fs_inp;
+        g = gcd(fs_out, fs_inp);
+        n = fs_out / g;
+        s = fs_inp / g;
+        if ((16 * r >= 1) && (n <= 1000))
+        {
+            h = hlen;
+            k = 250;
+            if (r < 1)
+            {
+                frel *= r;
+                h = (unsigned int)(ceil(h / r));
+                k = (unsigned int)(ceil(k / r));
+            }
+            T = Resampler_table::create(frel, h, n);
+            B = new float[nchan * (2 * h - 1 + k)];
+        }
+    }
+    clear();
+    if (T)
+    {
+        _table = T;
+        _buff = B;
+        _nchan = nchan;
+        _inmax = k;
+        _pstep = s;
+        _kernel = select_kernel(nchan);
+        return reset();
+    }
+    else return 1;
+}
+
+
+void Resampler::clear(void)
+{
+    Resampler_table::destroy(_table);
+    delete[] _buff;
+    _buff = 0;
+    _table = 0;
+    _kernel = 0;
+    _nchan = 0;
+    _inmax = 0;
+    _pstep = 0;
+    reset();
+}
+
+
+double Resampler::inpdist(void) const
+{
+    if (!_table) return 0;
+    return (int)(_table->_hl + 1 - _nread) - (double)_phase / _table->_np;
+}
+
+
+int Resampler::inpsize(void) const
+{
+    if (!_table) return 0;
+    return 2 * _table->_hl;
+}
+
+
+int Resampler::reset(void)
+{
+    if (!_table) return 1;
+
+    inp_count = 0;
+    out_count = 0;
+    inp_data = 0;
+    out_data = 0;
+    _index = 0;
+    _nread = 0;
+    _nzero = 0;
+    _phase = 0;
+    if (_table)
+    {
+        _nread = 2 * _table->_hl;
+        return 0;
+    }
+    return 1;
+}
+
+
+int Resampler::process(void)
+{
+    unsigned int   hl, ph, np, dp, in, nr, nz, i, n, c;
+    float* p1, * p2;
+
+    if (!_table) return 1;
+
+    hl = _table->_hl;
+    np = _table->_np;
+    dp = _pstep;
+    in = _index;
+    nr = _nread;
+    ph = _phase;
+    nz = _nzero;
+    n = (2 * hl - nr) * _nchan;
+    p1 = _buff + in * _nchan;
+    p2 = p1 + n;
+
+    while (out_count)
+    {
+        if (nr)
+        {
+            if (inp_count == 0) break;
+            if (inp_data)
+            {
+                for (c = 0; c < _nchan; c++) p2[c] = inp_data[c];
+                inp_data += _nchan;
+                nz = 0;
+            }
+            else
+            {
+                for (c = 0; c < _nchan; c++) p2[c] = 0;
+                if (nz < 2 * hl) nz++;
+            }
+            nr--;
+            p2 += _nchan;
+            inp_count--;
+        }
+        else
+        {
+            if (out_data)
+            {
+                if (nz < 2 * hl)
+                {
+                    float* c1 = _table->_ctab + hl * ph;
+                    float* c2 = _table->_ctab + hl * (np - ph);
+                    if (_kernel)
+                    {
+                        _kernel(p1, p2, c1, c2, hl, out_data);
+                        out_data += _nchan;
+                    }
+                    else for (c = 0; c < _nchan; c++)
+                    {
+                        float* q1 = p1 + c;
+                        float* q2 = p2 + c;
+                        float s = 1e-20f;
+                        for (i = 0; i < hl; i++)
+                        {
+                            q2 -= _nchan;
+                            s += *q1 * c1[i] + *q2 * c2[i];
+                            q1 += _nchan;
+                        }
+                        *out_data++ = s - 1e-20f;
+                    }
+                }
+                else
+                {
+                    for (c = 0; c < _nchan; c++) *out_data++ = 0;
+                }
+            }
+            out_count--;
+
+            ph += dp;
+            if (ph >= np)
+            {
+                nr = ph / np;
+                ph -= nr * np;
+                in += nr;
+                p1 += nr * _nchan;;
+                if (in >= _inmax)
+                {
+                    n = (2 * hl - nr) * _nchan;
+                    memcpy(_buff, p1, n * sizeof(float));
+                    in = 0;
+                    p1 = _buff;
+                    p2 = p1 + n;
+                }
+            }
+        }
+    }
+    _index = in;
+    _nread = nr;
+    _phase = ph;
+    _nzero = nz;
+
+    return 0;
+}
+
@@ -25,6 +25,12 @@
 #include "resampler-table.h"
 
 
+// Inner loop of Resampler::process (), one output sample per channel
+typedef void (*Resampler_kernel) (const float *q1, const float *q2,
+                                  const float *c1, const float *c2,
+                                  unsigned int hl, float *out);
+
+
 class Resampler
 {
 public:
@@ -51,6 +57,10 @@ public:
     double inpdist (void) const;
     int    process (void);
 
+    // Vector kernels for 1 and 2 channels are picked by setup()
+    // when the CPU has them. False forces the plain loop.
+    static bool          use_simd;
+
     unsigned int         inp_count;
     unsigned int         out_count;
     float               *inp_data;
@@ -69,6 +79,7 @@ private:
     unsigned int         _phase;
     unsigned int         _pstep;
     float               *_buff;
+    Resampler_kernel     _kernel;
     void                *_dummy [8];
 };
 
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+// Compares vector kernels with the plain loops, for the cases
+// used by the plugins: Resampler::process() on profile loads
+// and the halfband filters of Oversampler.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../thirdparty/zita-resampler/resampler.h"
+#include "../include/halfband.h"
+
+struct Result
+{
+  double nsPerSample;
+  std::vector<float> output;
+};
+
+static Result run(bool simd, unsigned int fsInp, unsigned int fsOut,
+                  unsigned int nchan, unsigned int hlen, int repeats)
+{
+  Resampler::use_simd = simd;
+
+  Resampler resampler;
+  resampler.setup(fsInp, fsOut, nchan, hlen);
+
+  const unsigned int count = 48000;
+  std::vector<float> input(count * nchan);
+  srand(1);
+  for (float &s : input)
+  {
+    s = (float)rand() / RAND_MAX - 0.5f;
+  }
+
+  unsigned int outCount = (unsigned int)((double)count * fsOut / fsInp);
+  Result result;
+  result.output.resize(outCount * nchan);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeats; r++)
+  {
+    resampler.reset();
+    resampler.inp_count = count;
+    resampler.out_count = outCount;
+    resampler.inp_data = input.data();
+    resampler.out_data = result.output.data();
+    resampler.process();
+  }
+  std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+
+  result.nsPerSample = time.count() / ((double)repeats * outCount * nchan);
+  return result;
+}
+
+// One halfband branch over a block of 2048 samples, as a 2x stage
+// runs it for a host block of 1024 samples
+static Result runHalfband(Halfband::Kernel kernel, int taps, int repeats)
+{
+  const int count = 2048;
+  std::vector<float> input(count + 2 * taps);
+  std::vector<float> coefs(taps);
+  srand(1);
+  for (float &s : input)
+  {
+    s = (float)rand() / RAND_MAX - 0.5f;
+  }
+  Halfband::design(coefs.data(), taps, 1.0);
+
+  Result result;
+  result.output.resize(count);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeats; r++)
+  {
+    kernel(input.data() + taps, coefs.data(), taps, result.output.data(), count);
+  }
+  std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+
+  result.nsPerSample = time.count() / ((double)repeats * count);
+  return result;
+}
+
+static double maxDiff(const Result &a, const Result &b)
+{
+  double diff = 0.0;
+  for (size_t i = 0; i < a.output.size(); i++)
+  {
+    diff = fmax(diff, fabs(a.output[i] - b.output[i]));
+  }
+  return diff;
+}
+
+int main()
+{
+  struct
+  {
+    const char *name;
+    unsigned int fsInp, fsOut, nchan, hlen;
+  } cases[] = {
+    {"IR 48000 -> 44100, mono   ", 48000, 44100, 1, 48},
+    {"IR 48000 -> 44100, stereo ", 48000, 44100, 2, 48},
+    {"IR 48000 -> 96000, stereo ", 48000, 96000, 2, 48},
+  };
+
+  printf("%-28s %12s %12s %8s %10s\n", "", "plain ns", "simd ns", "speedup", "max diff");
+  for (auto &c : cases)
+  {
+    Result plain = run(false, c.fsInp, c.fsOut, c.nchan, c.hlen, 20);
+    Result simd = run(true, c.fsInp, c.fsOut, c.nchan, c.hlen, 20);
+
+    printf("%-28s %12.2f %12.2f %7.2fx %10.2g\n", c.name, plain.nsPerSample,
+           simd.nsPerSample, plain.nsPerSample / simd.nsPerSample, maxDiff(plain, simd));
+  }
+
+  for (int taps : {8, 16, 48})
+  {
+    Result plain = runHalfband(Halfband::kernelPlain, taps, 2000);
+    Result simd = runHalfband(Halfband::selectKernel(), taps, 2000);
+
+    char name[32];
+    snprintf(name, sizeof(name), "Halfband, %d taps", taps);
+    printf("%-28s %12.2f %12.2f %7.2fx %10.2g\n", name, plain.nsPerSample,
+           simd.nsPerSample, plain.nsPerSample / simd.nsPerSample, maxDiff(plain, simd));
+  }
+
+  return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+// Compares Tonestack with a cascade of fi.peak_eq sections in
+// double precision, as FAUST code computes it, for block sizes
+// that exercise the pipeline ends, and times both. Fails with
+// a nonzero exit code when the float Tonestack errs more than
+// the float fi.peak_eq cascade it replaces, or the double one
+// by more than the bound.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../include/tonestack.h"
+
+// Largest error relative to the peak output, rounding
+// errors of float code are at least this large
+static const double kFloatBound = 1e-6;
+static const double kDoubleBound = 1e-11;
+
+struct Band
+{
+  double gain;
+  double freq;
+  double width;
+};
+
+// fi.peak_eq: fi.tf2s of the analog prototype, then fi.tf2
+template <typename T>
+class PeakEq
+{
+public:
+
+  PeakEq(const Band &band, double sampleRate)
+  {
+    const double pi = 3.14159265358979323846;
+    double t = 1.0 / sampleRate;
+    double wx = 2.0 * pi * band.freq;
+    double bw = band.width * t / sin(wx * t);
+    double g = pow(10.0, fabs(band.gain) / 20.0);
+    double a1p = pi * bw;
+    double b1p = g * a1p;
+    double b1s = (band.gain > 0) ? b1p : a1p;
+    double a1s = (band.gain > 0) ? a1p : b1p;
+
+    double c = 1.0 / tan(wx * 0.5 * t);
+    double csq = c * c;
+    double d = 1.0 + a1s * c + csq;
+    b0 = (1.0 + b1s * c + csq) / d;
+    b1 = 2.0 * (1.0 - csq) / d;
+    b2 = (1.0 - b1s * c + csq) / d;
+    a1 = 2.0 * (1.0 - csq) / d;
+    a2 = (1.0 - a1s * c + csq) / d;
+  }
+
+  T tick(T x)
+  {
+    T w = x - a1 * w1 - a2 * w2;
+    T out = b0 * w + b1 * w1 + b2 * w2;
+    w2 = w1;
+    w1 = w;
+    return out;
+  }
+
+private:
+  T b0, b1, b2, a1, a2;
+  T w1 = 0;
+  T w2 = 0;
+};
+
+template <typename T>
+static double error(const std::vector<double> &reference, const std::vector<T> &data)
+{
+  double error = 0.0;
+  double peak = 0.0;
+  for (size_t i = 0; i < reference.size(); i++)
+  {
+    error = fmax(error, fabs(reference[i] - (double)data[i]));
+    peak = fmax(peak, fabs(reference[i]));
+  }
+  return error / peak;
+}
+
+// Output of the fi.peak_eq cascade in precision T
+template <typename T>
+static std::vector<T> cascade(const Band *bands, double sampleRate, const std::vector<double> &input)
+{
+  std::vector<PeakEq<T>> sections;
+  for (int k = 0; k < kTonestackBands; k++)
+  {
+    sections.emplace_back(bands[k], sampleRate);
+  }
+
+  std::vector<T> output;
+  for (double s : input)
+  {
+    T out = (T)s;
+    for (PeakEq<T> &section : sections)
+    {
+      out = section.tick(out);
+    }
+    output.push_back(out);
+  }
+  return output;
+}
+
+template <typename T>
+static std::vector<T> run(const Band *bands, double sampleRate, const std::vector<double> &input,
+                          const std::vector<int> &blocks)
+{
+  Tonestack<T> tonestack;
+  tonestack.setRate(sampleRate);
+  for (int k = 0; k < kTonestackBands; k++)
+  {
+    tonestack.setGain(k, bands[k].gain);
+    tonestack.setBand(k, bands[k].freq, bands[k].width);
+  }
+
+  std::vector<T> data(input.begin(), input.end());
+  size_t pos = 0;
+  for (size_t b = 0; pos < data.size(); b++)
+  {
+    int count = blocks[b % blocks.size()];
+    if (count > (int)(data.size() - pos))
+    {
+      count = (int)(data.size() - pos);
+    }
+    tonestack.process(data.data() + pos, count);
+    pos += count;
+  }
+  return data;
+}
+
+template <typename Process>
+static double nsPerSample(int repeats, int count, Process &&process)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeats; r++)
+  {
+    process();
+  }
+  std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+  return time.count() / ((double)repeats * count);
+}
+
+int main()
+{
+  const Band settings[][kTonestackBands] = {
+    {{0, 100, 200}, {0, 700, 700}, {0, 3000, 2000}},
+    {{10, 100, 200}, {-10, 700, 700}, {10, 3000, 2000}},
+    {{-15, 70, 200}, {15, 500, 700}, {-15, 10000, 18000}},
+    {{15, 100, 200}, {15, 700, 700}, {-15, 3300, 2000}}
+  };
+  const double rates[] = {44100.0, 96000.0, 384000.0};
+  const std::vector<int> blocks[] = {{1}, {2}, {3}, {64}, {1, 2, 3, 5, 100, 7, 1024}};
+
+  std::vector<double> input(20000);
+  srand(1);
+  for (double &s : input)
+  {
+    s = (double)rand() / RAND_MAX - 0.5;
+  }
+
+  bool ok = true;
+  for (const Band *bands : settings)
+  {
+    for (double rate : rates)
+    {
+      std::vector<double> reference = cascade<double>(bands, rate, input);
+      double errorCascade = error(reference, cascade<float>(bands, rate, input));
+      double boundFloat = fmax(errorCascade, kFloatBound);
+
+      double errorFloat = 0.0;
+      double errorDouble = 0.0;
+      for (const std::vector<int> &sizes : blocks)
+      {
+        errorFloat = fmax(errorFloat, error(reference, run<float>(bands, rate, input, sizes)));
+        errorDouble = fmax(errorDouble, error(reference, run<double>(bands, rate, input, sizes)));
+      }
+
+      bool good = (errorFloat <= boundFloat) && (errorDouble <= kDoubleBound);
+      printf("%+3.0f %+3.0f %+3.0f dB %6.0f Hz  float %9.3g (fi.peak_eq %9.3g)  double %9.3g  %s\n",
+             bands[0].gain, bands[1].gain, bands[2].gain, rate,
+             errorFloat, errorCascade, errorDouble, good ? "ok" : "FAILED");
+      ok &= good;
+    }
+  }
+
+  // Block of a 1024 sample host block oversampled 2x
+  const int count = 2048;
+  const int repeats = 20000;
+  std::vector<float> data(input.begin(), input.begin() + count);
+
+  Tonestack<float> tonestack;
+  std::vector<PeakEq<float>> sections;
+  for (int k = 0; k < kTonestackBands; k++)
+  {
+    tonestack.setGain(k, settings[1][k].gain);
+    tonestack.setBand(k, settings[1][k].freq, settings[1][k].width);
+    sections.emplace_back(settings[1][k], 48000.0);
+  }
+
+  double timeCascade = nsPerSample(repeats, count, [&] () {
+    for (float &s : data)
+    {
+      s = sections[2].tick(sections[1].tick(sections[0].tick(s)));
+    }
+  });
+  double timeTonestack = nsPerSample(repeats, count, [&] () {
+    tonestack.process(data.data(), count);
+  });
+  printf("fi.peak_eq cascade %6.2f ns/sample, Tonestack %6.2f ns/sample\n",
+         timeCascade, timeTonestack);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+// Checks the error bounds stated in tubetables.h on dense
+// grids of float, double and long double arguments. Fails with a nonzero
+// exit code when a table errs by more than its bound.
+
+#include <stdio.h>
+#include <math.h>
+
+#include "../include/tubetables.h"
+
+// Bounds from the comment in tubetables.h
+static const double kTubeCurveBound = 9.0e-6;
+static const double kRecipBound = 3.9e-6;
+
+struct Error
+{
+  double value = 0.0;
+  double at = 0.0;
+
+  void update(long double fast, long double exact, double x)
+  {
+    double error = (double)fabsl(fast - exact);
+    if (error > value)
+    {
+      value = error;
+      at = x;
+    }
+  }
+};
+
+// 'pointsPerOctave' arguments in every octave from 2^minExp
+// to 2^maxExp, both ends and the last float below each
+// power of two included
+template <typename Check>
+static void grid(int minExp, int maxExp, int pointsPerOctave, Check &&check)
+{
+  for (int e = minExp; e < maxExp; e++)
+  {
+    double start = ldexp(1.0, e);
+    for (int i = 0; i < pointsPerOctave; i++)
+    {
+      check(start * (1.0 + (double)i / pointsPerOctave));
+    }
+    check((double)nextafterf((float)(2.0 * start), 0.0f));
+  }
+  check(ldexp(1.0, maxExp));
+}
+
+static bool report(const char *name, const Error &error, double bound)
+{
+  bool ok = error.value <= bound;
+  printf("%-24s %10.3g at %-14.8g bound %8.2g  %s\n", name, error.value,
+         error.at, bound, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main()
+{
+  const int points = 1 << 14;
+  bool ok = true;
+
+  // Whole range of the table and both of its tails
+  Error curvef, curve, curvel;
+  grid(-16, 24, points, [&] (double u) {
+    long double exact = (long double)u / (1.0L + (long double)u);
+    curve.update(kpp_tube_curve(u), exact, u);
+    curvel.update(kpp_tube_curvel((long double)u), exact, u);
+
+    float uf = (float)u;
+    long double exactf = (long double)uf / (1.0L + (long double)uf);
+    curvef.update(kpp_tube_curvef(uf), exactf, uf);
+  });
+  ok &= report("kpp_tube_curvef", curvef, kTubeCurveBound);
+  ok &= report("kpp_tube_curve", curve, kTubeCurveBound);
+  ok &= report("kpp_tube_curvel", curvel, kTubeCurveBound);
+
+  // [1, 4] with the end of the table
+  Error recipf, recip, recipl;
+  grid(0, 2, points * 16, [&] (double x) {
+    recip.update(kpp_recip(x), 1.0L / (long double)x, x);
+    recipl.update(kpp_recipl((long double)x), 1.0L / (long double)x, x);
+
+    float xf = (float)x;
+    recipf.update(kpp_recipf(xf), 1.0L / (long double)xf, xf);
+  });
+  ok &= report("kpp_recipf", recipf, kRecipBound);
+  ok &= report("kpp_recip", recip, kRecipBound);
+  ok &= report("kpp_recipl", recipl, kRecipBound);
+
+  return ok ? 0 : 1;
+}
@@ -22,6 +22,13 @@
 
 #include <map>
 #include <string>
+#include <vector>
+
+// Sample type of FAUST code, double when the plugins
+// are built with KPP_DOUBLE_PRECISION
+#ifndef FAUSTFLOAT
+#define FAUSTFLOAT float
+#endif
 
 // Needed for compatability with FAUST generated code
 struct Meta : std::map<const char*, const char*>
@@ -40,76 +47,58 @@ struct Meta : std::map<const char*, const char*>
 };
 
 
+// Binds plugin parameters to FAUST controls by label.
+// The FAUST code is split into several DSP classes (see
+// the *.dsp file), a control used by more than one of them
+// gets a pointer from each buildUserInterface() call.
 class UI {
 public:
    UI(){};
 
   void openVerticalBox(const char * name) {};
-  void addCheckButton(std::string label, float *fValue) {};
-  void addVerticalSlider(std::string label, float *fValue, float minValue, float maxValue, float defaultValue, float step) {
-    if (label == std::string("bass"))
-    {
-      bassValue = fValue;
-    }
-
-    if (label == std::string("middle"))
-    {
-      middleValue = fValue;
-    }
-
-    if (label == std::string("treble"))
-    {
-      trebleValue = fValue;
-    }
-
+  void addCheckButton(std::string label, FAUSTFLOAT *fValue) {};
+  void addVerticalSlider(std::string label, FAUSTFLOAT *fValue, float minValue, float maxValue, float defaultValue, float step) {
     if (label == std::string("drive"))
     {
-      gainValue = fValue;
+      gainValues.push_back(fValue);
     }
 
     if (label == std::string("volume"))
     {
-      volumeValue = fValue;
+      volumeValues.push_back(fValue);
     }
     if (label == std::string("voice"))
     {
-      voiceValue = fValue;
+      voiceValues.push_back(fValue);
     }
   }
 
   void closeBox() {};
 
-  void setBassValue(float value)
-  {
-    *bassValue = value;
-  }
-  void setMiddleValue(float value)
-  {
-    *middleValue = value;
-  }
-  void setTrebleValue(float value)
-  {
-    *trebleValue = value;
-  }
   void setGainValue(float value)
   {
-    *gainValue = value;
+    setValues(gainValues, value);
   }
   void setVolumeValue(float value)
   {
-    *volumeValue = value;
+    setValues(volumeValues, value);
   }
   void setVoiceValue(float value)
   {
-    *voiceValue = value;
+    setValues(voiceValues, value);
   }
 private:
-  float *bassValue;
-  float *middleValue;
-  float *trebleValue;
-  float *gainValue;
-  float *volumeValue;
-  float *voiceValue;
+  static void setValues(const std::vector<FAUSTFLOAT*> &values, float value)
+  {
+    for (FAUSTFLOAT *v : values)
+    {
+      *v = value;
+    }
+  }
+
+  std::vector<FAUSTFLOAT*> gainValues;
+  std::vector<FAUSTFLOAT*> volumeValues;
+  std::vector<FAUSTFLOAT*> voiceValues;
 };
 
 
@@ -187,7 +176,7 @@ class dsp {
          * @param outputs - the output audio buffers as an array of non-interleaved FAUSTFLOAT samples (eiher float, double or quad)
          *
          */
-        virtual void compute(int count, float** inputs, float** outputs) = 0;
+        virtual void compute(int count, FAUSTFLOAT** inputs, FAUSTFLOAT** outputs) = 0;
 
         /**
          * DSP instance computation: alternative method to be used by subclasses.
@@ -198,7 +187,7 @@ class dsp {
          * @param outputs - the output audio buffers as an array of non-interleaved FAUSTFLOAT samples (eiher float, double or quad)
          *
          */
-        virtual void compute(double date_usec, int count, float** inputs, float** outputs) { compute(count, inputs, outputs); }
+        virtual void compute(double date_usec, int count, FAUSTFLOAT** inputs, FAUSTFLOAT** outputs) { compute(count, inputs, outputs); }
 
 };
 
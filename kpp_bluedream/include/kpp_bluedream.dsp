@@ -30,7 +30,7 @@
  *
  *  pre-filter - highpass, 1 order, 720 Hz. Bypassed when _voice_ is in right position.
  *  overdrive - nonlinear element, emulation of the push-pull tube amplifier.
- *  equalizer - tonestack, bass-middle-treble.
+ *  equalizer - tonestack, bass-middle-treble, run by the plugin.
  *  post-filter - lowpass, 1 order, 720 Hz. Bypassed when _voice_ is in right position.
  */
 
@@ -40,27 +40,44 @@ declare license "GPLv3";
 declare version "1.2";
 
 import("stdfaust.lib");
+kt = library("kpp_tube.lib");
 
-process = output with {
+// The chain is split into four parts, each one is a separate
+// DSP class. Only the clippers, tubes and everything between
+// them run at the oversampled rate, linear parts before and
+// after them run at the host rate. The equalizer between the
+// tubes and the last clipper is Tonestack (see tonestack.h),
+// run by the plugin between the second and the third part.
 
-    // Bypass button, 0 - pedal on, 1 -pedal off (bypass on)
-    bypass = checkbox("99_bypass");
+// Clipper and tubes, before the equalizer
+process = stomp_chain(0, 1);
 
-    drive = vslider("drive",63,0,100,0.01);
-    volume = vslider("volume",0.5,0,1,0.001);
-    voice = vslider("voice",0.5,0,1,0.001);
+// The same with anti-aliased tubes,
+// used when Anti-aliasing is enabled
+process_adaa = stomp_chain(1, 1);
+
+// Clipper after the equalizer
+process_tail = stomp_chain(0, 2);
+
+// Input filter, before the clippers
+process_pre = stomp_chain(0, 0);
+
+// Output filters, after the clippers
+process_post = stomp_chain(0, 3);
 
-    tonestack_low = vslider("bass",0,-15,15,0.1);
-    tonestack_middle = vslider("middle",0,-15,15,0.1);
-    tonestack_high = vslider("treble",0,-15,15,0.1);
+// part - 0 input filter, 1 clipper and tubes, 2 clipper,
+// 3 output filters
+stomp_chain(adaa, part) = stomp_part(part) with {
 
-    tonestack_low_freq = 70;
-    tonestack_middle_freq = 500;
-    tonestack_high_freq = 10000;
+    // Model of tube nonlinear distortion, see kpp_tube.lib
+    tube(Kreg,Upor,bias,cut) = tube_mode(adaa) with {
+        tube_mode(0) = kt.tube(Kreg,Upor,bias,cut);
+        tube_mode(1) = kt.tube_adaa(Kreg,Upor,bias,cut);
+    };
 
-    tonestack_low_band = 200;
-    tonestack_middle_band = 700;
-    tonestack_high_band = 18000;
+    drive = vslider("drive",63,0,100,0.01);
+    volume = vslider("volume",0.5,0,1,0.001);
+    voice = vslider("voice",0.5,0,1,0.001);
 
     clamp = min(2.0) : max(-2.0);
 
@@ -74,17 +91,11 @@ process = output with {
     // Softness of distortion
     Kreg = 1.0;
 
-    tube(Kreg,Upor,bias,cut) = main : +(bias) : max(cut) with {
-        Ks(x) = 1/(max((x-Upor)*(Kreg),0)+1);
-        Ksplus(x) = Upor - x*Upor;
-        main(Uin) = (Uin * Ks(Uin) + Ksplus(Ks(Uin)));
-    };
-
     /*--------Processing chain-----------------*/
 
     // Used 2 tubes - for positive and negative half-waves (push-pull).
-    // Stereo input and output, but during processing the signal is
-    // converted to mono.
+    // Mono input and output, the plugin mixes stereo input down
+    // and duplicates the result to both output channels.
 
     pre_filter = _ <: fi.highpass(1, 720) * min((1 - voice + 0.75 * drive / 100), 1),
     *(max((voice - 0.75 * drive / 100), 0)) : + ;
@@ -93,18 +104,18 @@ process = output with {
     *(max((voice - 0.75 * drive / 100), 0)) : + ;
 
     stage_stomp = pre_filter : fi.lowpass(1,9000) : _<:
-    _,*(-1.0) : tube(Kreg,Upor,bias,0), tube(Kreg,Upor,bias,0) : - :
-    *(ba.db2linear(volume * 50.0 * (1 - voice * 0.25) ) / 100.0) :
-    fi.peak_eq(tonestack_low,tonestack_low_freq,tonestack_low_band) :
-    fi.peak_eq(tonestack_middle,tonestack_middle_freq,tonestack_middle_band) :
-    fi.peak_eq(tonestack_high,tonestack_high_freq,tonestack_high_band) :
-    clamp :
-    post_filter ;
-
-    stomp = fi.dcblocker : clamp : *(ba.db2linear(drive * 0.4 * (1 - voice * 0.5))-1)  :
-    stage_stomp : fi.dcblocker;
-
-    output = _,_ : + : ba.bypass1(bypass, stomp) <: _,_;
+    _,*(-1.0) : tube(Kreg,Upor,bias,0),
+    tube(Kreg,Upor,bias,0) : - :
+    *(ba.db2linear(volume * 50.0 * (1 - voice * 0.25) ) / 100.0);
+
+    stomp = clamp : *(ba.db2linear(drive * 0.4 * (1 - voice * 0.5))-1)  :
+    stage_stomp;
+
+    // Mono stomp, bypass is done by the plugin
+    stomp_part(0) = *(2.0) : fi.dcblocker;
+    stomp_part(1) = stomp;
+    stomp_part(2) = clamp;
+    stomp_part(3) = post_filter : fi.dcblocker;
 
 };
 
@@ -58,7 +58,14 @@ namespace Vst {
     kTrebleId = 104,
     kGainId = 105,
     kVolumeId = 106,
-    kVoiceId = 107
+    kVoiceId = 107,
+
+    // Applied on activation, change latency
+    kOversamplingId = 108,
+    kOfflineQualityId = 109,
+
+    // Anti-aliased tubes
+    kAntiAliasingId = 110
   };
 
 
@@ -49,8 +49,20 @@
 
 #include "public.sdk/source/vst/vstaudioeffect.h"
 
+#include <atomic>
+
 #include "faust-support.h"
+#include "../../common/include/paramautomation.h"
+#include "../../common/include/alignedbuffer.h"
+#include "../../common/include/silencedetector.h"
+#include "../../common/include/oversampler.h"
+#include "../../common/include/bypassdelay.h"
+#include "../../common/include/tonestack.h"
 #include "kpp_bluedream_dsp.h"
+#include "kpp_bluedream_adaa_dsp.h"
+#include "kpp_bluedream_pre_dsp.h"
+#include "kpp_bluedream_post_dsp.h"
+#include "kpp_bluedream_tail_dsp.h"
 
 namespace Steinberg {
 namespace Vst {
@@ -61,6 +73,7 @@ namespace Vst {
     PlugProcessor ();
 
     tresult PLUGIN_API initialize (FUnknown* context) SMTG_OVERRIDE;
+    tresult PLUGIN_API notify (IMessage* message) SMTG_OVERRIDE;
     tresult PLUGIN_API setBusArrangements (Vst::SpeakerArrangement* inputs, int32 numIns,
                                            Vst::SpeakerArrangement* outputs,
                                            int32 numOuts) SMTG_OVERRIDE;
@@ -68,6 +81,9 @@ namespace Vst {
                                            tresult PLUGIN_API setupProcessing (Vst::ProcessSetup& setup) SMTG_OVERRIDE;
                                            tresult PLUGIN_API setActive (TBool state) SMTG_OVERRIDE;
                                            tresult PLUGIN_API process (Vst::ProcessData& data) SMTG_OVERRIDE;
+                                           uint32 PLUGIN_API getTailSamples () SMTG_OVERRIDE;
+                                           uint32 PLUGIN_API getLatencySamples () SMTG_OVERRIDE;
+                                           tresult PLUGIN_API canProcessSampleSize (int32 symbolicSampleSize) SMTG_OVERRIDE;
 
                                            //------------------------------------------------------------------------
                                            tresult PLUGIN_API setState (IBStream* state) SMTG_OVERRIDE;
@@ -77,7 +93,48 @@ namespace Vst {
 
   protected:
 
-    BluedreamDsp *dsp;
+    void setParameter (Vst::ParamID id, Vst::ParamValue value);
+
+    // Settings used only by setActive(). They come from
+    // process() and from the controller, see settingsmessage.h
+    void setActivationSetting (Vst::ParamID id, Vst::ParamValue value);
+    bool settingsApplied ();
+    int oversamplingFactor (bool offlineQuality);
+
+    void applyAutomation (int32 offset);
+
+    template <typename SampleType>
+    void processAudio (Vst::ProcessData& data, SampleType** in, SampleType** out);
+
+    Vst::ParamAutomation automation;
+
+    // FAUST code sleeps after the input has been
+    // silent longer than its tail
+    Vst::SilenceDetector silence;
+
+    // Nonlinear FAUST section runs at 'factor' times the host rate
+    Oversampler oversampler;
+
+    // Bypassed signal is delayed by the oversampler latency
+    BypassDelay bypass;
+
+    // FAUST input/output when host precision differs
+    AlignedBuffer<FAUSTFLOAT> faustBuf;
+
+    // Oversampled FAUST section data
+    AlignedBuffer<FAUSTFLOAT> faustHigh;
+
+    // BluedreamDsp, or BluedreamAdaaDsp with anti-aliasing
+    ::dsp *dsp;
+    bool adaaDsp = false;
+
+    // Bass, middle and treble between dsp and tailDsp
+    Tonestack<FAUSTFLOAT> tonestack;
+    BluedreamTailDsp *tailDsp;
+
+    // Linear parts before and after the oversampled section
+    BluedreamPreDsp *preDsp;
+    BluedreamPostDsp *postDsp;
     UI *ui;
 
     float sampleRate;
@@ -89,6 +146,12 @@ namespace Vst {
     ParamValue mVolume = 0;
     ParamValue mVoice = 0;
     bool mBypass = false;
+
+    // Activation settings, also written by notify()
+    std::atomic<ParamValue> mOversampling {0};
+    std::atomic<bool> mOfflineQuality {false};
+    std::atomic<bool> mAntiAliasing {false};
+    bool activeOfflineQuality = false;
   };
 
   //------------------------------------------------------------------------
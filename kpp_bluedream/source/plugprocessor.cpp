@@ -47,11 +47,18 @@
 
 #include "../include/plugprocessor.h"
 #include "../include/plugids.h"
+#include "../../common/include/sampleconvert.h"
+#include "../../common/include/settingsmessage.h"
 
 #include "base/source/fstreamer.h"
 #include "pluginterfaces/base/ibstream.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 
+// Decay time of FAUST code with silent input, in seconds.
+// Slowest parts are the two DC blockers (pole 0.995),
+// filters of the tone stack decay much faster.
+#define DSP_TAIL_TIME 0.15
+
 namespace Steinberg {
 namespace Vst {
 
@@ -59,6 +66,9 @@ namespace Vst {
   {
     setControllerClass (MyControllerUID);
     dsp = nullptr;
+    preDsp = nullptr;
+    postDsp = nullptr;
+    tailDsp = nullptr;
     ui = nullptr;
   }
 
@@ -87,7 +97,10 @@ namespace Vst {
                                                         Vst::SpeakerArrangement* outputs,
                                                         int32 numOuts)
   {
-    if (numIns == 1 && numOuts == 1 && inputs[0] == outputs[0])
+    // FAUST code is mono, so mono input may feed stereo output
+    if (numIns == 1 && numOuts == 1 &&
+        ((inputs[0] == outputs[0]) ||
+         ((inputs[0] == SpeakerArr::kMono) && (outputs[0] == SpeakerArr::kStereo))))
     {
       return AudioEffect::setBusArrangements (inputs, numIns, outputs, numOuts);
     }
@@ -101,14 +114,104 @@ namespace Vst {
     return AudioEffect::setupProcessing (setup);
   }
 
+  // 64-bit samples are processed only when FAUST code
+  // is built with them, otherwise the host converts
+  tresult PLUGIN_API PlugProcessor::canProcessSampleSize (int32 symbolicSampleSize)
+  {
+    if (symbolicSampleSize == kSample32)
+      return kResultTrue;
+    if ((symbolicSampleSize == kSample64) && (sizeof (FAUSTFLOAT) == sizeof (Sample64)))
+      return kResultTrue;
+    return kResultFalse;
+  }
+
+  uint32 PLUGIN_API PlugProcessor::getTailSamples ()
+  {
+    return (uint32)(DSP_TAIL_TIME * sampleRate) + oversampler.latency ();
+  }
+
+  uint32 PLUGIN_API PlugProcessor::getLatencySamples ()
+  {
+    return oversampler.latency ();
+  }
+
+  tresult PLUGIN_API PlugProcessor::notify (IMessage* message)
+  {
+    ParamID id;
+    ParamValue value;
+    if (readSetting (message, id, value))
+    {
+      setActivationSetting (id, value);
+      if (!settingsApplied ())
+      {
+        sendRestart (this);
+      }
+      return kResultOk;
+    }
+    return AudioEffect::notify (message);
+  }
+
   tresult PLUGIN_API PlugProcessor::setActive (TBool state)
   {
     if (state)
     {
-      dsp = new BluedreamDsp();
+      // Anti-aliased tubes are a separate DSP class,
+      // so that only one tube model runs per sample
+      adaaDsp = mAntiAliasing;
+      if (adaaDsp)
+      {
+        dsp = new BluedreamAdaaDsp();
+      }
+      else
+      {
+        dsp = new BluedreamDsp();
+      }
+      preDsp = new BluedreamPreDsp();
+      postDsp = new BluedreamPostDsp();
+      tailDsp = new BluedreamTailDsp();
       ui = new UI();
-      dsp->init(sampleRate);
+
+      // Oversampling settings are applied here, the controller
+      // restarts the component when they are changed. Offline
+      // renders may use the highest factor with longer filters.
+      bool offlineQuality = mOfflineQuality && (processSetup.processMode == kOffline);
+      int factor = oversamplingFactor (offlineQuality);
+      activeOfflineQuality = offlineQuality;
+      int32 blockSize = std::max (processSetup.maxSamplesPerBlock, (int32)ParamAutomation::kRampBlock);
+
+      oversampler.setup (factor,
+                         offlineQuality ? Oversampler::kOfflineFilter : Oversampler::kRealtimeFilter,
+                         blockSize);
+      bypass.setup (oversampler.latency ());
+      faustBuf.allocate (blockSize);
+      faustHigh.allocate (blockSize * oversampler.factor ());
+
+      // Only the nonlinear section runs at the oversampled rate
+      preDsp->init(sampleRate);
+      dsp->init(sampleRate * oversampler.factor ());
+      tailDsp->init(sampleRate * oversampler.factor ());
+      postDsp->init(sampleRate);
+      preDsp->buildUserInterface(ui);
       dsp->buildUserInterface(ui);
+      tailDsp->buildUserInterface(ui);
+      postDsp->buildUserInterface(ui);
+
+      // Bands of the pedal, gains are set by the knobs
+      tonestack.setRate (sampleRate * oversampler.factor ());
+      tonestack.setBand (kTonestackLow, 70, 200);
+      tonestack.setBand (kTonestackMiddle, 500, 700);
+      tonestack.setBand (kTonestackHigh, 10000, 18000);
+      tonestack.reset ();
+
+      silence.setTailSamples ((int32)(DSP_TAIL_TIME * sampleRate) + oversampler.latency ());
+      silence.reset ();
+
+      setParameter (kBassId, mBass);
+      setParameter (kMiddleId, mMiddle);
+      setParameter (kTrebleId, mTreble);
+      setParameter (kGainId, mGain);
+      setParameter (kVolumeId, mVolume);
+      setParameter (kVoiceId, mVoice);
     }
     else
     {
@@ -117,6 +220,21 @@ namespace Vst {
         delete dsp;
         dsp = nullptr;
       }
+      if (preDsp != nullptr)
+      {
+        delete preDsp;
+        preDsp = nullptr;
+      }
+      if (postDsp != nullptr)
+      {
+        delete postDsp;
+        postDsp = nullptr;
+      }
+      if (tailDsp != nullptr)
+      {
+        delete tailDsp;
+        tailDsp = nullptr;
+      }
       if (ui != nullptr)
       {
         delete ui;
@@ -128,6 +246,8 @@ namespace Vst {
 
   tresult PLUGIN_API PlugProcessor::process (ProcessData& data)
   {
+    automation.clear ();
+
     if (data.inputParameterChanges)
     {
       int32 numParamsChanged = data.inputParameterChanges->getParameterCount ();
@@ -143,58 +263,35 @@ namespace Vst {
           switch (paramQueue->getParameterId ())
           {
             case kBassId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mBass = value;
-                ui->setBassValue((value * 2.0 - 1.0) * 15.0);
-              }
+              automation.addQueue (paramQueue, mBass);
               break;
             case kMiddleId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mMiddle = value;
-                ui->setMiddleValue((value * 2.0 - 1.0) * 15.0);
-              }
+              automation.addQueue (paramQueue, mMiddle);
               break;
             case kTrebleId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mTreble = value;
-                ui->setTrebleValue((value * 2.0 - 1.0) * 15.0);
-              }
+              automation.addQueue (paramQueue, mTreble);
               break;
             case kGainId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mGain = value;
-                ui->setGainValue(value * 100.0);
-              }
+              automation.addQueue (paramQueue, mGain);
               break;
             case kVolumeId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mVolume = value;
-                ui->setVolumeValue(value);
-              }
+              automation.addQueue (paramQueue, mVolume);
               break;
             case kVoiceId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mVoice = value;
-                ui->setVoiceValue(value);
-              }
+              automation.addQueue (paramQueue, mVoice);
               break;
             case kBypassId:
               if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
                 kResultTrue)
                 mBypass = (value > 0.5f);
               break;
+            case kOversamplingId:
+            case kOfflineQualityId:
+            case kAntiAliasingId:
+              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
+                kResultTrue)
+                setActivationSetting (paramQueue->getParameterId (), value);
+              break;
           }
         }
       }
@@ -202,48 +299,56 @@ namespace Vst {
 
     if (data.numInputs == 0 || data.numOutputs == 0)
     {
+      applyAutomation (data.numSamples);
       return kResultOk;
     }
 
     if (data.numSamples > 0)
     {
-      SpeakerArrangement arr;
-      getBusArrangement (kOutput, 0, arr);
-      int32 numChannels = SpeakerArr::getChannelCount (arr);
-
-      float* inputs[2];
-      float* outputs[2];
-
-      if (numChannels >= 2)
+      if (!mBypass && silence.update (data.inputs[0], data.numSamples,
+                                      data.symbolicSampleSize))
       {
-        inputs[0] = data.inputs[0].channelBuffers32[0];
-        inputs[1] = data.inputs[0].channelBuffers32[1];
-
-        outputs[0] = data.outputs[0].channelBuffers32[0];
-        outputs[1] = data.outputs[0].channelBuffers32[1];
+        // Input has been silent longer than the tail
+        SilenceDetector::silence (data.outputs[0], data.numSamples,
+                                  data.symbolicSampleSize);
       }
       else
       {
-        inputs[0] = data.inputs[0].channelBuffers32[0];
-        inputs[1] = data.inputs[0].channelBuffers32[0];
-
-        outputs[0] = data.outputs[0].channelBuffers32[0];
-        outputs[1] = data.outputs[0].channelBuffers32[0];
-      }
+        if (!mBypass)
+        {
+          // State left after sleeping is decayed, but not exactly zero
+          if (silence.wokeUp ())
+          {
+            preDsp->instanceClear ();
+            dsp->instanceClear ();
+            tailDsp->instanceClear ();
+            postDsp->instanceClear ();
+            tonestack.reset ();
+            oversampler.reset ();
+          }
+          data.outputs[0].silenceFlags = 0;
+        }
+        else
+        {
+          silence.reset ();
+          data.outputs[0].silenceFlags = data.inputs[0].silenceFlags;
+        }
 
-      if (!mBypass)
-      {
-        dsp->compute(data.numSamples, inputs, outputs);
-      }
-      else
-      {
-        for (int i = 0; i < data.numSamples; i++)
+        if (data.symbolicSampleSize == kSample64)
         {
-          outputs[0][i] = inputs[0][i];
-          outputs[1][i] = inputs[1][i];
+          processAudio (data, data.inputs[0].channelBuffers64,
+                        data.outputs[0].channelBuffers64);
+        }
+        else
+        {
+          processAudio (data, data.inputs[0].channelBuffers32,
+                        data.outputs[0].channelBuffers32);
         }
       }
     }
+
+    applyAutomation (data.numSamples);
+
     return kResultOk;
   }
 
@@ -290,12 +395,31 @@ namespace Vst {
     mVoice = savedVoice;
     mBypass = savedBypass > 0;
 
-    ui->setBassValue(mBass);
-    ui->setMiddleValue(mMiddle);
-    ui->setTrebleValue(mTreble);
-    ui->setGainValue(mGain);
-    ui->setVolumeValue(mVolume);
-    ui->setVoiceValue(mVoice);
+    // Oversampling settings are absent
+    // in states saved by older versions
+    float savedOversampling = 0.f;
+    if (streamer.readFloat (savedOversampling) == false)
+      savedOversampling = 0.f;
+
+    int32 savedOfflineQuality = 0;
+    if (streamer.readInt32 (savedOfflineQuality) == false)
+      savedOfflineQuality = 0;
+
+    mOversampling = savedOversampling;
+    mOfflineQuality = savedOfflineQuality > 0;
+
+    int32 savedAntiAliasing = 0;
+    if (streamer.readInt32 (savedAntiAliasing) == false)
+      savedAntiAliasing = 0;
+
+    mAntiAliasing = savedAntiAliasing > 0;
+
+    setParameter (kBassId, mBass);
+    setParameter (kMiddleId, mMiddle);
+    setParameter (kTrebleId, mTreble);
+    setParameter (kGainId, mGain);
+    setParameter (kVolumeId, mVolume);
+    setParameter (kVoiceId, mVoice);
 
     return kResultOk;
   }
@@ -309,6 +433,9 @@ namespace Vst {
     float toSaveVolume = mVolume;
     float toSaveVoice = mVoice;
     int32 toSaveBypass = mBypass ? 1 : 0;
+    float toSaveOversampling = mOversampling;
+    int32 toSaveOfflineQuality = mOfflineQuality ? 1 : 0;
+    int32 toSaveAntiAliasing = mAntiAliasing ? 1 : 0;
 
     IBStreamer streamer (state, kLittleEndian);
     streamer.writeFloat (toSaveBass);
@@ -318,9 +445,169 @@ namespace Vst {
     streamer.writeFloat (toSaveVolume);
     streamer.writeFloat (toSaveVoice);
     streamer.writeInt32 (toSaveBypass);
+    streamer.writeFloat (toSaveOversampling);
+    streamer.writeInt32 (toSaveOfflineQuality);
+    streamer.writeInt32 (toSaveAntiAliasing);
 
     return kResultOk;
   }
 
+  // Renders one block in host precision,
+  // FAUST code runs in its own (FAUSTFLOAT)
+  template <typename SampleType>
+  void PlugProcessor::processAudio (ProcessData& data, SampleType** in, SampleType** out)
+  {
+    if (!mBypass)
+    {
+      // FAUST code is mono. Stereo input is mixed down
+      // into the first output channel and processed in place.
+      SampleType* input = in[0];
+      SampleType* output = out[0];
+
+      if (data.inputs[0].numChannels >= 2)
+      {
+        for (int i = 0; i < data.numSamples; i++)
+        {
+          output[i] = (in[0][i] + in[1][i]) * (SampleType)0.5;
+        }
+        input = output;
+      }
+
+      // Render in sub-blocks split at automation points
+      int32 pos = 0;
+      while (pos < data.numSamples)
+      {
+        int32 end = automation.nextSplit (pos, data.numSamples);
+        int32 maxLength = faustBuf.size ();
+        if (end - pos > maxLength)
+        {
+          end = pos + maxLength;
+        }
+        applyAutomation (end);
+
+        // Host buffers are used directly when their precision
+        // matches FAUST code, otherwise through faustBuf
+        FAUSTFLOAT* subInput = convertSamples (input + pos, faustBuf.data (), end - pos);
+        FAUSTFLOAT* subOutput = outputSamples (output + pos, faustBuf.data ());
+        preDsp->compute (end - pos, &subInput, &subOutput);
+
+        if (oversampler.factor () > 1)
+        {
+          oversampler.process (subOutput, subOutput, end - pos, [this] (float* high, int count) {
+            FAUSTFLOAT* highData = convertSamples (high, faustHigh.data (), count);
+            dsp->compute (count, &highData, &highData);
+            tonestack.process (highData, count);
+            tailDsp->compute (count, &highData, &highData);
+            storeSamples (highData, high, count);
+          });
+        }
+        else
+        {
+          dsp->compute (end - pos, &subOutput, &subOutput);
+          tonestack.process (subOutput, end - pos);
+          tailDsp->compute (end - pos, &subOutput, &subOutput);
+        }
+
+        postDsp->compute (end - pos, &subOutput, &subOutput);
+        storeSamples (subOutput, output + pos, end - pos);
+
+        pos = end;
+      }
+
+      // Mono result is duplicated to the second channel once
+      if (data.outputs[0].numChannels >= 2)
+      {
+        memcpy (out[1], out[0], data.numSamples * sizeof (SampleType));
+      }
+    }
+    else
+    {
+      bypass.process (in, data.inputs[0].numChannels,
+                      out, data.outputs[0].numChannels,
+                      data.numSamples, oversampler.latency ());
+    }
+  }
+
+  void PlugProcessor::setActivationSetting (ParamID id, ParamValue value)
+  {
+    switch (id)
+    {
+      case kOversamplingId:
+        mOversampling = value;
+        break;
+      case kOfflineQualityId:
+        mOfflineQuality = (value > 0.5f);
+        break;
+      case kAntiAliasingId:
+        mAntiAliasing = (value > 0.5f);
+        break;
+    }
+  }
+
+  // True when setActive() would build the same DSP class
+  // and oversampler as the ones in use with the current settings
+  bool PlugProcessor::settingsApplied ()
+  {
+    bool offlineQuality = mOfflineQuality && (processSetup.processMode == kOffline);
+    return (oversampler.factor () == oversamplingFactor (offlineQuality)) &&
+      (activeOfflineQuality == offlineQuality) &&
+      (adaaDsp == mAntiAliasing);
+  }
+
+  // Offline renders may use the highest factor
+  int PlugProcessor::oversamplingFactor (bool offlineQuality)
+  {
+    return offlineQuality ? (int)Oversampler::kMaxFactor :
+      (1 << (int)(mOversampling * 3.0 + 0.5));
+  }
+
+  // Sets normalized parameter value and updates linked FAUST control
+  void PlugProcessor::setParameter (ParamID id, ParamValue value)
+  {
+    switch (id)
+    {
+      case kBassId:
+        mBass = value;
+        tonestack.setGain (kTonestackLow, (value * 2.0 - 1.0) * 15.0);
+        break;
+      case kMiddleId:
+        mMiddle = value;
+        tonestack.setGain (kTonestackMiddle, (value * 2.0 - 1.0) * 15.0);
+        break;
+      case kTrebleId:
+        mTreble = value;
+        tonestack.setGain (kTonestackHigh, (value * 2.0 - 1.0) * 15.0);
+        break;
+      case kGainId:
+        mGain = value;
+        if (ui)
+        {
+          ui->setGainValue(value * 100.0);
+        }
+        break;
+      case kVolumeId:
+        mVolume = value;
+        if (ui)
+        {
+          ui->setVolumeValue(value);
+        }
+        break;
+      case kVoiceId:
+        mVoice = value;
+        if (ui)
+        {
+          ui->setVoiceValue(value);
+        }
+        break;
+    }
+  }
+
+  void PlugProcessor::applyAutomation (int32 offset)
+  {
+    automation.apply (offset, [this] (ParamID id, ParamValue value) {
+      setParameter (id, value);
+    });
+  }
+
 } // Vst
 } // Steinberg
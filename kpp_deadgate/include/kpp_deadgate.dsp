@@ -57,8 +57,9 @@ process = output with {
     ef.gate_mono(noizegate_knob, 0.01, 0.02, 0.02),
     ef.gate_mono(noizegate_knob, 0.01, 0.02, 0.02) :> _;
 
-    output = _,_ :> fi.highpass(1,10) : deadzone : multigate :
-    *(ba.db2linear(-6.0)) <: _,_ ;
+    // Mono gate chain
+    output = *(2.0) : fi.highpass(1,10) : deadzone : multigate :
+    *(ba.db2linear(-6.0));
 };
 
 
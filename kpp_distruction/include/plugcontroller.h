@@ -72,6 +72,7 @@ namespace Vst {
     IPlugView* PLUGIN_API createView (const char* name) SMTG_OVERRIDE;
     tresult PLUGIN_API setComponentState (IBStream* state) SMTG_OVERRIDE;
     tresult PLUGIN_API setParamNormalized (ParamID tag, ParamValue value) SMTG_OVERRIDE;
+    tresult PLUGIN_API notify (IMessage* message) SMTG_OVERRIDE;
     tresult PLUGIN_API getParamStringByValue (ParamID tag, ParamValue valueNormalized,
                                               String128 string) SMTG_OVERRIDE;
                                               tresult PLUGIN_API getParamValueByString (ParamID tag, TChar* string,
@@ -22,6 +22,13 @@
 
 #include <map>
 #include <string>
+#include <vector>
+
+// Sample type of FAUST code, double when the plugins
+// are built with KPP_DOUBLE_PRECISION
+#ifndef FAUSTFLOAT
+#define FAUSTFLOAT float
+#endif
 
 // Needed for compatability with FAUST generated code
 struct Meta : std::map<const char*, const char*>
@@ -40,26 +47,30 @@ struct Meta : std::map<const char*, const char*>
 };
 
 
+// Binds plugin parameters to FAUST controls by label.
+// The FAUST code is split into several DSP classes (see
+// the *.dsp file), a control used by more than one of them
+// gets a pointer from each buildUserInterface() call.
 class UI {
 public:
    UI(){};
 
   void openVerticalBox(const char * name) {};
-  void addCheckButton(std::string label, float *fValue) {};
-  void addVerticalSlider(std::string label, float *fValue, float minValue, float maxValue, float defaultValue, float step) {
+  void addCheckButton(std::string label, FAUSTFLOAT *fValue) {};
+  void addVerticalSlider(std::string label, FAUSTFLOAT *fValue, float minValue, float maxValue, float defaultValue, float step) {
     if (label == std::string("fuzz"))
     {
-      fuzzValue = fValue;
+      fuzzValues.push_back(fValue);
     }
 
     if (label == std::string("tone"))
     {
-      toneValue = fValue;
+      toneValues.push_back(fValue);
     }
 
     if (label == std::string("volume"))
     {
-      volumeValue = fValue;
+      volumeValues.push_back(fValue);
     }
   }
 
@@ -67,20 +78,28 @@ public:
 
   void setFuzzValue(float value)
   {
-    *fuzzValue = value;
+    setValues(fuzzValues, value);
   }
   void setToneValue(float value)
   {
-    *toneValue = value;
+    setValues(toneValues, value);
   }
   void setVolumeValue(float value)
   {
-    *volumeValue = value;
+    setValues(volumeValues, value);
   }
 private:
-  float *fuzzValue;
-  float *toneValue;
-  float *volumeValue;
+  static void setValues(const std::vector<FAUSTFLOAT*> &values, float value)
+  {
+    for (FAUSTFLOAT *v : values)
+    {
+      *v = value;
+    }
+  }
+
+  std::vector<FAUSTFLOAT*> fuzzValues;
+  std::vector<FAUSTFLOAT*> toneValues;
+  std::vector<FAUSTFLOAT*> volumeValues;
 };
 
 
@@ -158,7 +177,7 @@ class dsp {
          * @param outputs - the output audio buffers as an array of non-interleaved FAUSTFLOAT samples (eiher float, double or quad)
          *
          */
-        virtual void compute(int count, float** inputs, float** outputs) = 0;
+        virtual void compute(int count, FAUSTFLOAT** inputs, FAUSTFLOAT** outputs) = 0;
 
         /**
          * DSP instance computation: alternative method to be used by subclasses.
@@ -169,7 +188,7 @@ class dsp {
          * @param outputs - the output audio buffers as an array of non-interleaved FAUSTFLOAT samples (eiher float, double or quad)
          *
          */
-        virtual void compute(double date_usec, int count, float** inputs, float** outputs) { compute(count, inputs, outputs); }
+        virtual void compute(double date_usec, int count, FAUSTFLOAT** inputs, FAUSTFLOAT** outputs) { compute(count, inputs, outputs); }
 
 };
 
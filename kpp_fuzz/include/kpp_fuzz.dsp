@@ -39,10 +39,21 @@ declare version "1.2";
 
 import("stdfaust.lib");
 
-process = output with {
+// The chain is split into three parts, each one is a separate
+// DSP class. Only the distortion runs at the oversampled rate,
+// linear parts before and after it run at the host rate.
 
-    // Bypass button, 0 - pedal on, 1 -pedal off (bypass on)
-    bypass = checkbox("99_bypass");
+// Distortion
+process = fuzz_chain(1);
+
+// Input filters, before the distortion
+process_pre = fuzz_chain(0);
+
+// Output gain, after the distortion
+process_post = fuzz_chain(2);
+
+// part - 0 input filters, 1 distortion, 2 output gain
+fuzz_chain(part) = stomp_part(part) with {
 
     fuzz = vslider("fuzz",50,0,100,0.01);
     tone = vslider("tone",-7.5,-15,0,0.1);
@@ -61,16 +72,16 @@ process = output with {
 
     distortion = *(100.0) : *(ba.db2linear(fuzz/5.0) - 1.0) : biaser :
       *(ba.db2linear(fuzz/100.0*6.0)) :
-      max(-50.0) : min(100.0) : fi.dcblocker;
+      max(-50.0) : min(100.0);
 
     filter = fi.high_shelf(tone + 12.5, 720.0);
 
-    stomp = pre_filter : filter : distortion :
-    *(ba.db2linear(volume * 25.0 ) / 100.0) :
+    // Mono stomp, bypass is done by the plugin
+    stomp_part(0) = *(2.0) : pre_filter : filter;
+    stomp_part(1) = distortion;
+    stomp_part(2) = fi.dcblocker : *(ba.db2linear(volume * 25.0 ) / 100.0) :
     /(20.0);
 
-    output = _,_ : + : ba.bypass1(bypass, stomp) <: _,_;
-
 };
 
 
@@ -57,7 +57,11 @@ namespace Steinberg {
 
       kFuzzId = 102,
       kToneId = 103,
-      kVolumeId = 104
+      kVolumeId = 104,
+
+      // Applied on activation, change latency
+      kOversamplingId = 105,
+      kOfflineQualityId = 106
     };
 
 
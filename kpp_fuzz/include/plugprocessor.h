@@ -49,8 +49,17 @@
 
 #include "public.sdk/source/vst/vstaudioeffect.h"
 
+#include <atomic>
+
 #include "faust-support.h"
+#include "../../common/include/paramautomation.h"
+#include "../../common/include/alignedbuffer.h"
+#include "../../common/include/silencedetector.h"
+#include "../../common/include/oversampler.h"
+#include "../../common/include/bypassdelay.h"
 #include "kpp_fuzz_dsp.h"
+#include "kpp_fuzz_pre_dsp.h"
+#include "kpp_fuzz_post_dsp.h"
 
 namespace Steinberg {
   namespace Vst {
@@ -62,6 +71,7 @@ namespace Steinberg {
       PlugProcessor ();
 
       tresult PLUGIN_API initialize (FUnknown* context) SMTG_OVERRIDE;
+      tresult PLUGIN_API notify (IMessage* message) SMTG_OVERRIDE;
       tresult PLUGIN_API setBusArrangements (Vst::SpeakerArrangement* inputs, int32 numIns,
                                              Vst::SpeakerArrangement* outputs,
                                              int32 numOuts) SMTG_OVERRIDE;
@@ -69,6 +79,9 @@ namespace Steinberg {
                                              tresult PLUGIN_API setupProcessing (Vst::ProcessSetup& setup) SMTG_OVERRIDE;
                                              tresult PLUGIN_API setActive (TBool state) SMTG_OVERRIDE;
                                              tresult PLUGIN_API process (Vst::ProcessData& data) SMTG_OVERRIDE;
+                                             uint32 PLUGIN_API getTailSamples () SMTG_OVERRIDE;
+                                             uint32 PLUGIN_API getLatencySamples () SMTG_OVERRIDE;
+                                             tresult PLUGIN_API canProcessSampleSize (int32 symbolicSampleSize) SMTG_OVERRIDE;
 
                                              //------------------------------------------------------------------------
                                              tresult PLUGIN_API setState (IBStream* state) SMTG_OVERRIDE;
@@ -78,7 +91,42 @@ namespace Steinberg {
 
     protected:
 
+      void setParameter (Vst::ParamID id, Vst::ParamValue value);
+
+      // Settings used only by setActive(). They come from
+      // process() and from the controller, see settingsmessage.h
+      void setActivationSetting (Vst::ParamID id, Vst::ParamValue value);
+      bool settingsApplied ();
+      int oversamplingFactor (bool offlineQuality);
+
+      void applyAutomation (int32 offset);
+
+      template <typename SampleType>
+      void processAudio (Vst::ProcessData& data, SampleType** in, SampleType** out);
+
+      Vst::ParamAutomation automation;
+
+      // FAUST code sleeps after the input has been
+      // silent longer than its tail
+      Vst::SilenceDetector silence;
+
+      // Nonlinear FAUST section runs at 'factor' times the host rate
+      Oversampler oversampler;
+
+      // Bypassed signal is delayed by the oversampler latency
+      BypassDelay bypass;
+
+      // FAUST input/output when host precision differs
+      AlignedBuffer<FAUSTFLOAT> faustBuf;
+
+      // Oversampled FAUST section data
+      AlignedBuffer<FAUSTFLOAT> faustHigh;
+
       FuzzDsp *dsp;
+
+      // Linear parts before and after the oversampled section
+      FuzzPreDsp *preDsp;
+      FuzzPostDsp *postDsp;
       UI *ui;
 
       float sampleRate;
@@ -87,6 +135,11 @@ namespace Steinberg {
       Vst::ParamValue mTone = 0;
       Vst::ParamValue mVolume = 0;
       bool mBypass = false;
+
+      // Activation settings, also written by notify()
+      std::atomic<Vst::ParamValue> mOversampling {0};
+      std::atomic<bool> mOfflineQuality {false};
+      bool activeOfflineQuality = false;
     };
 
     //------------------------------------------------------------------------
@@ -52,6 +52,7 @@
 #include "base/source/fstreamer.h"
 #include "base/source/fstring.h"
 #include "pluginterfaces/base/ibstream.h"
+#include "../../common/include/settingsmessage.h"
 
 using namespace VSTGUI;
 
@@ -167,6 +168,20 @@ namespace Vst {
       parameters.addParameter (STR16 ("Volume"), NULL, 0, .5,
                                ParameterInfo::kCanAutomate, kVolumeId, 0,
                                STR16 ("Volume"));
+
+      // Change latency, so not automatable
+      StringListParameter* oversamplingParam =
+        new StringListParameter (STR16 ("Oversampling"), kOversamplingId, nullptr,
+                                 ParameterInfo::kIsList);
+      oversamplingParam->appendString (STR16 ("Off"));
+      oversamplingParam->appendString (STR16 ("2x"));
+      oversamplingParam->appendString (STR16 ("4x"));
+      oversamplingParam->appendString (STR16 ("8x"));
+      parameters.addParameter (oversamplingParam);
+
+      // Offline renders use 8x oversampling with longer filters
+      parameters.addParameter (STR16 ("Offline Quality"), nullptr, 1, 0,
+                               ParameterInfo::kNoFlags, kOfflineQualityId);
     }
     return kResultTrue;
   }
@@ -209,15 +224,49 @@ namespace Vst {
       return kResultFalse;
     setParamNormalized (kBypassId, bypassState ? 1 : 0);
 
+    // Oversampling settings are absent
+    // in states saved by older versions
+    float savedOversampling = 0.f;
+    if (streamer.readFloat (savedOversampling) == false)
+      savedOversampling = 0.f;
+    setParamNormalized (kOversamplingId, savedOversampling);
+
+    int32 offlineQualityState = 0;
+    if (streamer.readInt32 (offlineQualityState) == false)
+      offlineQualityState = 0;
+    setParamNormalized (kOfflineQualityId, offlineQualityState ? 1 : 0);
+
     return kResultOk;
   }
 
   tresult PLUGIN_API PlugController::setParamNormalized (ParamID tag, ParamValue value)
   {
+    bool settingChanged = ((tag == kOversamplingId) || (tag == kOfflineQualityId)) &&
+      (getParamNormalized (tag) != value);
+
     tresult result = EditControllerEx1::setParamNormalized (tag, value);
+
+    // The processor answers when the component has to be restarted
+    if (settingChanged)
+    {
+      sendSetting (this, tag, value);
+    }
     return result;
   }
 
+  tresult PLUGIN_API PlugController::notify (IMessage* message)
+  {
+    if (isRestart (message))
+    {
+      if (componentHandler)
+      {
+        componentHandler->restartComponent (kLatencyChanged);
+      }
+      return kResultOk;
+    }
+    return EditControllerEx1::notify (message);
+  }
+
   tresult PLUGIN_API PlugController::getParamStringByValue (ParamID tag, ParamValue valueNormalized,
                                                             String128 string)
   {
@@ -47,11 +47,18 @@
 
 #include "../include/plugprocessor.h"
 #include "../include/plugids.h"
+#include "../../common/include/sampleconvert.h"
+#include "../../common/include/settingsmessage.h"
 
 #include "base/source/fstreamer.h"
 #include "pluginterfaces/base/ibstream.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 
+// Decay time of FAUST code with silent input, in seconds.
+// Bias follower in the distortion decays with 10 ms time
+// constant (-120 dB after about 0.14 s), followed by DC blockers.
+#define DSP_TAIL_TIME 0.25
+
 namespace Steinberg {
 namespace Vst {
 
@@ -59,6 +66,8 @@ namespace Vst {
   {
     setControllerClass (MyControllerUID);
     dsp = nullptr;
+    preDsp = nullptr;
+    postDsp = nullptr;
     ui = nullptr;
   }
 
@@ -84,7 +93,10 @@ namespace Vst {
                                                         Vst::SpeakerArrangement* outputs,
                                                         int32 numOuts)
   {
-    if (numIns == 1 && numOuts == 1 && inputs[0] == outputs[0])
+    // FAUST code is mono, so mono input may feed stereo output
+    if (numIns == 1 && numOuts == 1 &&
+        ((inputs[0] == outputs[0]) ||
+         ((inputs[0] == SpeakerArr::kMono) && (outputs[0] == SpeakerArr::kStereo))))
     {
       return AudioEffect::setBusArrangements (inputs, numIns, outputs, numOuts);
     }
@@ -97,14 +109,81 @@ namespace Vst {
     return AudioEffect::setupProcessing (setup);
   }
 
+  // 64-bit samples are processed only when FAUST code
+  // is built with them, otherwise the host converts
+  tresult PLUGIN_API PlugProcessor::canProcessSampleSize (int32 symbolicSampleSize)
+  {
+    if (symbolicSampleSize == kSample32)
+      return kResultTrue;
+    if ((symbolicSampleSize == kSample64) && (sizeof (FAUSTFLOAT) == sizeof (Sample64)))
+      return kResultTrue;
+    return kResultFalse;
+  }
+
+  uint32 PLUGIN_API PlugProcessor::getTailSamples ()
+  {
+    return (uint32)(DSP_TAIL_TIME * sampleRate) + oversampler.latency ();
+  }
+
+  uint32 PLUGIN_API PlugProcessor::getLatencySamples ()
+  {
+    return oversampler.latency ();
+  }
+
+  tresult PLUGIN_API PlugProcessor::notify (IMessage* message)
+  {
+    ParamID id;
+    ParamValue value;
+    if (readSetting (message, id, value))
+    {
+      setActivationSetting (id, value);
+      if (!settingsApplied ())
+      {
+        sendRestart (this);
+      }
+      return kResultOk;
+    }
+    return AudioEffect::notify (message);
+  }
+
   tresult PLUGIN_API PlugProcessor::setActive (TBool state)
   {
     if (state)
     {
       dsp = new FuzzDsp();
+      preDsp = new FuzzPreDsp();
+      postDsp = new FuzzPostDsp();
       ui = new UI();
-      dsp->init(sampleRate);
+
+      // Oversampling settings are applied here, the controller
+      // restarts the component when they are changed. Offline
+      // renders may use the highest factor with longer filters.
+      bool offlineQuality = mOfflineQuality && (processSetup.processMode == kOffline);
+      int factor = oversamplingFactor (offlineQuality);
+      activeOfflineQuality = offlineQuality;
+      int32 blockSize = std::max (processSetup.maxSamplesPerBlock, (int32)ParamAutomation::kRampBlock);
+
+      oversampler.setup (factor,
+                         offlineQuality ? Oversampler::kOfflineFilter : Oversampler::kRealtimeFilter,
+                         blockSize);
+      bypass.setup (oversampler.latency ());
+      faustBuf.allocate (blockSize);
+      faustHigh.allocate (blockSize * oversampler.factor ());
+
+      // Only the nonlinear section runs at the oversampled rate
+      preDsp->init(sampleRate);
+      dsp->init(sampleRate * oversampler.factor ());
+      postDsp->init(sampleRate);
+      preDsp->buildUserInterface(ui);
       dsp->buildUserInterface(ui);
+      postDsp->buildUserInterface(ui);
+
+      silence.setTailSamples ((int32)(DSP_TAIL_TIME * sampleRate) + oversampler.latency ());
+      silence.reset ();
+
+      setParameter (kFuzzId, mFuzz);
+      setParameter (kToneId, mTone);
+      setParameter (kVolumeId, mVolume);
     }
     else
     {
@@ -113,6 +192,16 @@ namespace Vst {
         delete dsp;
         dsp = nullptr;
       }
+      if (preDsp != nullptr)
+      {
+        delete preDsp;
+        preDsp = nullptr;
+      }
+      if (postDsp != nullptr)
+      {
+        delete postDsp;
+        postDsp = nullptr;
+      }
       if (ui != nullptr)
       {
         delete ui;
@@ -124,6 +213,8 @@ namespace Vst {
 
   tresult PLUGIN_API PlugProcessor::process (Vst::ProcessData& data)
   {
+    automation.clear ();
+
     if (data.inputParameterChanges)
     {
       int32 numParamsChanged = data.inputParameterChanges->getParameterCount ();
@@ -139,34 +230,25 @@ namespace Vst {
           switch (paramQueue->getParameterId ())
           {
             case kFuzzId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mFuzz = value;
-                ui->setFuzzValue(value * 100.0);
-              }
+              automation.addQueue (paramQueue, mFuzz);
               break;
             case kToneId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mTone = value;
-                ui->setToneValue((value - 1.0) * 15.0);
-              }
+              automation.addQueue (paramQueue, mTone);
               break;
             case kVolumeId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mVolume = value;
-                ui->setVolumeValue(value);
-              }
+              automation.addQueue (paramQueue, mVolume);
               break;
             case kBypassId:
               if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
                 kResultTrue)
                 mBypass = (value > 0.5f);
               break;
+            case kOversamplingId:
+            case kOfflineQualityId:
+              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
+                kResultTrue)
+                setActivationSetting (paramQueue->getParameterId (), value);
+              break;
           }
         }
       }
@@ -174,48 +256,54 @@ namespace Vst {
 
     if (data.numInputs == 0 || data.numOutputs == 0)
     {
+      applyAutomation (data.numSamples);
       return kResultOk;
     }
 
     if (data.numSamples > 0)
     {
-      SpeakerArrangement arr;
-      getBusArrangement(kOutput, 0, arr);
-      int32 numChannels = SpeakerArr::getChannelCount(arr);
-
-      float* inputs[2];
-      float* outputs[2];
-
-      if (numChannels >= 2)
+      if (!mBypass && silence.update (data.inputs[0], data.numSamples,
+                                      data.symbolicSampleSize))
       {
-        inputs[0] = data.inputs[0].channelBuffers32[0];
-        inputs[1] = data.inputs[0].channelBuffers32[1];
-
-        outputs[0] = data.outputs[0].channelBuffers32[0];
-        outputs[1] = data.outputs[0].channelBuffers32[1];
+        // Input has been silent longer than the tail
+        SilenceDetector::silence (data.outputs[0], data.numSamples,
+                                  data.symbolicSampleSize);
       }
       else
       {
-        inputs[0] = data.inputs[0].channelBuffers32[0];
-        inputs[1] = data.inputs[0].channelBuffers32[0];
-
-        outputs[0] = data.outputs[0].channelBuffers32[0];
-        outputs[1] = data.outputs[0].channelBuffers32[0];
-      }
+        if (!mBypass)
+        {
+          // State left after sleeping is decayed, but not exactly zero
+          if (silence.wokeUp ())
+          {
+            preDsp->instanceClear ();
+            dsp->instanceClear ();
+            postDsp->instanceClear ();
+            oversampler.reset ();
+          }
+          data.outputs[0].silenceFlags = 0;
+        }
+        else
+        {
+          silence.reset ();
+          data.outputs[0].silenceFlags = data.inputs[0].silenceFlags;
+        }
 
-      if (!mBypass)
-      {
-        dsp->compute(data.numSamples, inputs, outputs);
-      }
-      else
-      {
-        for (int i = 0; i < data.numSamples; i++)
+        if (data.symbolicSampleSize == kSample64)
+        {
+          processAudio (data, data.inputs[0].channelBuffers64,
+                        data.outputs[0].channelBuffers64);
+        }
+        else
         {
-          outputs[0][i] = inputs[0][i];
-          outputs[1][i] = inputs[1][i];
+          processAudio (data, data.inputs[0].channelBuffers32,
+                        data.outputs[0].channelBuffers32);
         }
       }
     }
+
+    applyAutomation (data.numSamples);
+
     return kResultOk;
   }
 
@@ -247,9 +335,22 @@ namespace Vst {
     mVolume = savedVolume;
     mBypass = savedBypass > 0;
 
-    ui->setFuzzValue(mFuzz);
-    ui->setToneValue(mTone);
-    ui->setVolumeValue(mVolume);
+    // Oversampling settings are absent
+    // in states saved by older versions
+    float savedOversampling = 0.f;
+    if (streamer.readFloat (savedOversampling) == false)
+      savedOversampling = 0.f;
+
+    int32 savedOfflineQuality = 0;
+    if (streamer.readInt32 (savedOfflineQuality) == false)
+      savedOfflineQuality = 0;
+
+    mOversampling = savedOversampling;
+    mOfflineQuality = savedOfflineQuality > 0;
+
+    setParameter (kFuzzId, mFuzz);
+    setParameter (kToneId, mTone);
+    setParameter (kVolumeId, mVolume);
 
     return kResultOk;
   }
@@ -260,15 +361,156 @@ namespace Vst {
     float toSaveTone = mTone;
     float toSaveVolume = mVolume;
     int32 toSaveBypass = mBypass ? 1 : 0;
+    float toSaveOversampling = mOversampling;
+    int32 toSaveOfflineQuality = mOfflineQuality ? 1 : 0;
 
     IBStreamer streamer (state, kLittleEndian);
     streamer.writeFloat (toSaveFuzz);
     streamer.writeFloat (toSaveTone);
     streamer.writeFloat (toSaveVolume);
     streamer.writeInt32 (toSaveBypass);
+    streamer.writeFloat (toSaveOversampling);
+    streamer.writeInt32 (toSaveOfflineQuality);
 
     return kResultOk;
   }
 
+  // Renders one block in host precision,
+  // FAUST code runs in its own (FAUSTFLOAT)
+  template <typename SampleType>
+  void PlugProcessor::processAudio (ProcessData& data, SampleType** in, SampleType** out)
+  {
+    if (!mBypass)
+    {
+      // FAUST code is mono. Stereo input is mixed down
+      // into the first output channel and processed in place.
+      SampleType* input = in[0];
+      SampleType* output = out[0];
+
+      if (data.inputs[0].numChannels >= 2)
+      {
+        for (int i = 0; i < data.numSamples; i++)
+        {
+          output[i] = (in[0][i] + in[1][i]) * (SampleType)0.5;
+        }
+        input = output;
+      }
+
+      // Render in sub-blocks split at automation points
+      int32 pos = 0;
+      while (pos < data.numSamples)
+      {
+        int32 end = automation.nextSplit (pos, data.numSamples);
+        int32 maxLength = faustBuf.size ();
+        if (end - pos > maxLength)
+        {
+          end = pos + maxLength;
+        }
+        applyAutomation (end);
+
+        // Host buffers are used directly when their precision
+        // matches FAUST code, otherwise through faustBuf
+        FAUSTFLOAT* subInput = convertSamples (input + pos, faustBuf.data (), end - pos);
+        FAUSTFLOAT* subOutput = outputSamples (output + pos, faustBuf.data ());
+        preDsp->compute (end - pos, &subInput, &subOutput);
+
+        if (oversampler.factor () > 1)
+        {
+          oversampler.process (subOutput, subOutput, end - pos, [this] (float* high, int count) {
+            FAUSTFLOAT* highData = convertSamples (high, faustHigh.data (), count);
+            dsp->compute (count, &highData, &highData);
+            storeSamples (highData, high, count);
+          });
+        }
+        else
+        {
+          dsp->compute (end - pos, &subOutput, &subOutput);
+        }
+
+        postDsp->compute (end - pos, &subOutput, &subOutput);
+        storeSamples (subOutput, output + pos, end - pos);
+
+        pos = end;
+      }
+
+      // Mono result is duplicated to the second channel once
+      if (data.outputs[0].numChannels >= 2)
+      {
+        memcpy (out[1], out[0], data.numSamples * sizeof (SampleType));
+      }
+    }
+    else
+    {
+      bypass.process (in, data.inputs[0].numChannels,
+                      out, data.outputs[0].numChannels,
+                      data.numSamples, oversampler.latency ());
+    }
+  }
+
+  void PlugProcessor::setActivationSetting (ParamID id, ParamValue value)
+  {
+    switch (id)
+    {
+      case kOversamplingId:
+        mOversampling = value;
+        break;
+      case kOfflineQualityId:
+        mOfflineQuality = (value > 0.5f);
+        break;
+    }
+  }
+
+  // True when setActive() would set up the oversampler
+  // as the one in use with the current settings
+  bool PlugProcessor::settingsApplied ()
+  {
+    bool offlineQuality = mOfflineQuality && (processSetup.processMode == kOffline);
+    return (oversampler.factor () == oversamplingFactor (offlineQuality)) &&
+      (activeOfflineQuality == offlineQuality);
+  }
+
+  // Offline renders may use the highest factor
+  int PlugProcessor::oversamplingFactor (bool offlineQuality)
+  {
+    return offlineQuality ? (int)Oversampler::kMaxFactor :
+      (1 << (int)(mOversampling * 3.0 + 0.5));
+  }
+
+  // Sets normalized parameter value and updates linked FAUST control
+  void PlugProcessor::setParameter (ParamID id, ParamValue value)
+  {
+    switch (id)
+    {
+      case kFuzzId:
+        mFuzz = value;
+        if (ui)
+        {
+          ui->setFuzzValue(value * 100.0);
+        }
+        break;
+      case kToneId:
+        mTone = value;
+        if (ui)
+        {
+          ui->setToneValue((value - 1.0) * 15.0);
+        }
+        break;
+      case kVolumeId:
+        mVolume = value;
+        if (ui)
+        {
+          ui->setVolumeValue(value);
+        }
+        break;
+    }
+  }
+
+  void PlugProcessor::applyAutomation (int32 offset)
+  {
+    automation.apply (offset, [this] (ParamID id, ParamValue value) {
+      setParameter (id, value);
+    });
+  }
+
 } // Vst
 } // Steinberg
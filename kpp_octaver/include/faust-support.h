@@ -23,6 +23,12 @@
 #include <map>
 #include <string>
 
+// Sample type of FAUST code, double when the plugins
+// are built with KPP_DOUBLE_PRECISION
+#ifndef FAUSTFLOAT
+#define FAUSTFLOAT float
+#endif
+
 // Needed for compatability with FAUST generated code
 struct Meta : std::map<const char*, const char*>
 {
@@ -45,8 +51,8 @@ public:
    UI(){};
 
   void openVerticalBox(const char * name) {};
-  void addCheckButton(std::string label, float *fValue) {};
-  void addVerticalSlider(std::string label, float *fValue, float minValue, float maxValue, float defaultValue, float step) {
+  void addCheckButton(std::string label, FAUSTFLOAT *fValue) {};
+  void addVerticalSlider(std::string label, FAUSTFLOAT *fValue, float minValue, float maxValue, float defaultValue, float step) {
     if (label == std::string("octave1"))
     {
       octave1Value = fValue;
@@ -87,10 +93,10 @@ public:
     *cutoffValue = value;
   }
 private:
-  float *octave1Value;
-  float *octave2Value;
-  float *dryValue;
-  float *cutoffValue;
+  FAUSTFLOAT *octave1Value;
+  FAUSTFLOAT *octave2Value;
+  FAUSTFLOAT *dryValue;
+  FAUSTFLOAT *cutoffValue;
 };
 
 
@@ -168,7 +174,7 @@ class dsp {
          * @param outputs - the output audio buffers as an array of non-interleaved FAUSTFLOAT samples (eiher float, double or quad)
          *
          */
-        virtual void compute(int count, float** inputs, float** outputs) = 0;
+        virtual void compute(int count, FAUSTFLOAT** inputs, FAUSTFLOAT** outputs) = 0;
 
         /**
          * DSP instance computation: alternative method to be used by subclasses.
@@ -179,7 +185,7 @@ class dsp {
          * @param outputs - the output audio buffers as an array of non-interleaved FAUSTFLOAT samples (eiher float, double or quad)
          *
          */
-        virtual void compute(double date_usec, int count, float** inputs, float** outputs) { compute(count, inputs, outputs); }
+        virtual void compute(double date_usec, int count, FAUSTFLOAT** inputs, FAUSTFLOAT** outputs) { compute(count, inputs, outputs); }
 
 };
 
@@ -71,7 +71,8 @@ process = output with {
     stomp =  _ <: down1,down2 : *(level_d1),*(level_d2) :
       + : *(2.0) : fi.dcblocker;
 
-    output = _,_ : + <: *(level_dry),ba.bypass1(bypass, stomp) : + <: _,_;
+    // Dry signal mixed with both octaves down, mono
+    output = *(2.0) <: *(level_dry),ba.bypass1(bypass, stomp) : +;
 
 };
 
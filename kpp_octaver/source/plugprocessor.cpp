@@ -47,11 +47,17 @@
 
 #include "../include/plugprocessor.h"
 #include "../include/plugids.h"
+#include "../../common/include/sampleconvert.h"
 
 #include "base/source/fstreamer.h"
 #include "pluginterfaces/base/ibstream.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 
+// Decay time of FAUST code with silent input, in seconds.
+// Octave signals are the input modulated by the square waves,
+// they decay with 40-80 Hz filters and the DC blocker.
+#define DSP_TAIL_TIME 0.2
+
 namespace Steinberg {
 namespace Vst {
 
@@ -87,7 +93,10 @@ namespace Vst {
                                                         Vst::SpeakerArrangement* outputs,
                                                         int32 numOuts)
   {
-    if (numIns == 1 && numOuts == 1 && inputs[0] == outputs[0])
+    // FAUST code is mono, so mono input may feed stereo output
+    if (numIns == 1 && numOuts == 1 &&
+        ((inputs[0] == outputs[0]) ||
+         ((inputs[0] == SpeakerArr::kMono) && (outputs[0] == SpeakerArr::kStereo))))
     {
       return AudioEffect::setBusArrangements (inputs, numIns, outputs, numOuts);
     }
@@ -97,9 +106,26 @@ namespace Vst {
   tresult PLUGIN_API PlugProcessor::setupProcessing (Vst::ProcessSetup& setup)
   {
     sampleRate = setup.sampleRate;
+    faustBuf.allocate (std::max (setup.maxSamplesPerBlock, (int32)ParamAutomation::kRampBlock));
     return AudioEffect::setupProcessing (setup);
   }
 
+  // 64-bit samples are processed only when FAUST code
+  // is built with them, otherwise the host converts
+  tresult PLUGIN_API PlugProcessor::canProcessSampleSize (int32 symbolicSampleSize)
+  {
+    if (symbolicSampleSize == kSample32)
+      return kResultTrue;
+    if ((symbolicSampleSize == kSample64) && (sizeof (FAUSTFLOAT) == sizeof (Sample64)))
+      return kResultTrue;
+    return kResultFalse;
+  }
+
+  uint32 PLUGIN_API PlugProcessor::getTailSamples ()
+  {
+    return (uint32)(DSP_TAIL_TIME * sampleRate);
+  }
+
   tresult PLUGIN_API PlugProcessor::setActive (TBool state)
   {
     if (state)
@@ -108,6 +134,14 @@ namespace Vst {
       ui = new UI();
       dsp->init(sampleRate);
       dsp->buildUserInterface(ui);
+
+      silence.setTailSamples ((int32)(DSP_TAIL_TIME * sampleRate));
+      silence.reset ();
+
+      setParameter (kCutoffId, mCutoff);
+      setParameter (kDryId, mDry);
+      setParameter (kOctave1Id, mOctave1);
+      setParameter (kOctave2Id, mOctave2);
     }
     else
     {
@@ -127,6 +161,8 @@ namespace Vst {
 
   tresult PLUGIN_API PlugProcessor::process (ProcessData& data)
   {
+    automation.clear ();
+
     if (data.inputParameterChanges)
     {
       int32 numParamsChanged = data.inputParameterChanges->getParameterCount ();
@@ -142,36 +178,16 @@ namespace Vst {
           switch (paramQueue->getParameterId ())
           {
             case kCutoffId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mCutoff = value;
-                ui->setCutoffValue((value + 1.0) * 100.0);
-              }
+              automation.addQueue (paramQueue, mCutoff);
               break;
             case kDryId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mDry = value;
-                ui->setDryValue(value * 30.0);
-              }
+              automation.addQueue (paramQueue, mDry);
               break;
             case kOctave1Id:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mOctave1 = value;
-                ui->setOctave1Value(value * 30.0);
-              }
+              automation.addQueue (paramQueue, mOctave1);
               break;
             case kOctave2Id:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mOctave2 = value;
-                ui->setOctave2Value(value * 30.0);
-              }
+              automation.addQueue (paramQueue, mOctave2);
               break;
             case kBypassId:
               if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
@@ -185,48 +201,51 @@ namespace Vst {
 
     if (data.numInputs == 0 || data.numOutputs == 0)
     {
+      applyAutomation (data.numSamples);
       return kResultOk;
     }
 
     if (data.numSamples > 0)
     {
-      SpeakerArrangement arr;
-      getBusArrangement(kOutput, 0, arr);
-      int32 numChannels = SpeakerArr::getChannelCount(arr);
-
-      float* inputs[2];
-      float* outputs[2];
-
-      if (numChannels >= 2)
+      if (!mBypass && silence.update (data.inputs[0], data.numSamples,
+                                      data.symbolicSampleSize))
       {
-        inputs[0] = data.inputs[0].channelBuffers32[0];
-        inputs[1] = data.inputs[0].channelBuffers32[1];
-
-        outputs[0] = data.outputs[0].channelBuffers32[0];
-        outputs[1] = data.outputs[0].channelBuffers32[1];
+        // Input has been silent longer than the tail
+        SilenceDetector::silence (data.outputs[0], data.numSamples,
+                                  data.symbolicSampleSize);
       }
       else
       {
-        inputs[0] = data.inputs[0].channelBuffers32[0];
-        inputs[1] = data.inputs[0].channelBuffers32[0];
-
-        outputs[0] = data.outputs[0].channelBuffers32[0];
-        outputs[1] = data.outputs[0].channelBuffers32[0];
-      }
+        if (!mBypass)
+        {
+          // State left after sleeping is decayed, but not exactly zero
+          if (silence.wokeUp ())
+          {
+            dsp->instanceClear ();
+          }
+          data.outputs[0].silenceFlags = 0;
+        }
+        else
+        {
+          silence.reset ();
+          data.outputs[0].silenceFlags = data.inputs[0].silenceFlags;
+        }
 
-      if (!mBypass)
-      {
-        dsp->compute(data.numSamples, inputs, outputs);
-      }
-      else
-      {
-        for (int i = 0; i < data.numSamples; i++)
+        if (data.symbolicSampleSize == kSample64)
+        {
+          processAudio (data, data.inputs[0].channelBuffers64,
+                        data.outputs[0].channelBuffers64);
+        }
+        else
         {
-          outputs[0][i] = inputs[0][i];
-          outputs[1][i] = inputs[1][i];
+          processAudio (data, data.inputs[0].channelBuffers32,
+                        data.outputs[0].channelBuffers32);
         }
       }
     }
+
+    applyAutomation (data.numSamples);
+
     return kResultOk;
   }
 
@@ -263,10 +282,10 @@ namespace Vst {
     mOctave2 = savedOctave2;
     mBypass = savedBypass > 0;
 
-    ui->setCutoffValue(mCutoff);
-    ui->setDryValue(mDry);
-    ui->setOctave1Value(mOctave1);
-    ui->setOctave1Value(mOctave2);
+    setParameter (kCutoffId, mCutoff);
+    setParameter (kDryId, mDry);
+    setParameter (kOctave1Id, mOctave1);
+    setParameter (kOctave2Id, mOctave2);
 
     return kResultOk;
   }
@@ -289,5 +308,109 @@ namespace Vst {
     return kResultOk;
   }
 
+  // Renders one block in host precision,
+  // FAUST code runs in its own (FAUSTFLOAT)
+  template <typename SampleType>
+  void PlugProcessor::processAudio (ProcessData& data, SampleType** in, SampleType** out)
+  {
+    if (!mBypass)
+    {
+      // FAUST code is mono. Stereo input is mixed down
+      // into the first output channel and processed in place.
+      SampleType* input = in[0];
+      SampleType* output = out[0];
+
+      if (data.inputs[0].numChannels >= 2)
+      {
+        for (int i = 0; i < data.numSamples; i++)
+        {
+          output[i] = (in[0][i] + in[1][i]) * (SampleType)0.5;
+        }
+        input = output;
+      }
+
+      // Render in sub-blocks split at automation points
+      int32 pos = 0;
+      while (pos < data.numSamples)
+      {
+        int32 end = automation.nextSplit (pos, data.numSamples);
+        if (end - pos > (int32)faustBuf.size ())
+        {
+          end = pos + faustBuf.size ();
+        }
+        applyAutomation (end);
+
+        // Host buffers are used directly when their precision
+        // matches FAUST code, otherwise through faustBuf
+        FAUSTFLOAT* subInput = convertSamples (input + pos, faustBuf.data (), end - pos);
+        FAUSTFLOAT* subOutput = outputSamples (output + pos, faustBuf.data ());
+        dsp->compute (end - pos, &subInput, &subOutput);
+        storeSamples (subOutput, output + pos, end - pos);
+
+        pos = end;
+      }
+
+      // Mono result is duplicated to the second channel once
+      if (data.outputs[0].numChannels >= 2)
+      {
+        memcpy (out[1], out[0], data.numSamples * sizeof (SampleType));
+      }
+    }
+    else
+    {
+      for (int32 c = 0; (c < data.outputs[0].numChannels) && (c < 2); c++)
+      {
+        SampleType* src = (c < data.inputs[0].numChannels) ? in[c] : in[0];
+        if (src != out[c])
+        {
+          memcpy (out[c], src, data.numSamples * sizeof (SampleType));
+        }
+      }
+    }
+  }
+
+  // Sets normalized parameter value and updates linked FAUST control
+  void PlugProcessor::setParameter (ParamID id, ParamValue value)
+  {
+    switch (id)
+    {
+      case kCutoffId:
+        mCutoff = value;
+        if (ui)
+        {
+          ui->setCutoffValue((value + 1.0) * 100.0);
+        }
+        break;
+      case kDryId:
+        mDry = value;
+        if (ui)
+        {
+          ui->setDryValue(value * 30.0);
+        }
+        break;
+      case kOctave1Id:
+        mOctave1 = value;
+        if (ui)
+        {
+          ui->setOctave1Value(value * 30.0);
+        }
+        break;
+      case kOctave2Id:
+        mOctave2 = value;
+        if (ui)
+        {
+          ui->setOctave2Value(value * 30.0);
+        }
+        break;
+    }
+  }
+
+  void PlugProcessor::applyAutomation (int32 offset)
+  {
+    automation.apply (offset, [this] (ParamID id, ParamValue value) {
+      setParameter (id, value);
+    });
+  }
+
 } // Vst
 } // Steinberg
@@ -46,8 +46,9 @@ process = output with {
   filter = fi.highpass(1,filter_knob);
 
 
-  output = _,_ :> _ <: (*(effect_knob) : effect), (*(1.0 - effect_knob)) : + :
-  filter : *(ba.db2linear(-10.0)) <: _,_ ;
+  // Effect blended with the dry signal and filtered, mono
+  output = *(2.0) <: (*(effect_knob) : effect), (*(1.0 - effect_knob)) : + :
+  filter : *(ba.db2linear(-10.0));
 };
 
 
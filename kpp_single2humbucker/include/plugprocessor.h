@@ -50,6 +50,9 @@
 #include "public.sdk/source/vst/vstaudioeffect.h"
 
 #include "faust-support.h"
+#include "../../common/include/paramautomation.h"
+#include "../../common/include/alignedbuffer.h"
+#include "../../common/include/silencedetector.h"
 #include "kpp_single2humbucker_dsp.h"
 
 namespace Steinberg {
@@ -68,6 +71,8 @@ namespace Vst {
                                            tresult PLUGIN_API setupProcessing (Vst::ProcessSetup& setup) SMTG_OVERRIDE;
                                            tresult PLUGIN_API setActive (TBool state) SMTG_OVERRIDE;
                                            tresult PLUGIN_API process (Vst::ProcessData& data) SMTG_OVERRIDE;
+                                           uint32 PLUGIN_API getTailSamples () SMTG_OVERRIDE;
+                                           tresult PLUGIN_API canProcessSampleSize (int32 symbolicSampleSize) SMTG_OVERRIDE;
 
                                            //------------------------------------------------------------------------
                                            tresult PLUGIN_API setState (IBStream* state) SMTG_OVERRIDE;
@@ -77,6 +82,21 @@ namespace Vst {
 
   protected:
 
+    void setParameter (Vst::ParamID id, Vst::ParamValue value);
+    void applyAutomation (int32 offset);
+
+    template <typename SampleType>
+    void processAudio (Vst::ProcessData& data, SampleType** in, SampleType** out);
+
+    Vst::ParamAutomation automation;
+
+    // FAUST code sleeps after the input has been
+    // silent longer than its tail
+    Vst::SilenceDetector silence;
+
+    // FAUST input/output when host precision differs
+    AlignedBuffer<FAUSTFLOAT> faustBuf;
+
     Single2humbuckerDsp *dsp;
     UI *ui;
 
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef CONVPROCFIFO_H
+#define CONVPROCFIFO_H
+
+#include <vector>
+
+#ifndef HAVE_STRUCT_TIMESPEC
+#define HAVE_STRUCT_TIMESPEC
+#endif
+#include "../thirdparty/zita-convolver/zita-convolver.h"
+
+// Input/output FIFO around Convproc.
+//
+// Convproc works with blocks of exactly 'quantum' samples,
+// host blocks may have any size. Input is collected in
+// the convolver input buffers, the convolver runs each time
+// a full quantum is collected and output is read back
+// from the previous quantum. So the output is always
+// delayed by 'quantum' samples, whatever the host block size.
+//
+// Optional dry buffers, one per convolver input, are delayed
+// by the same amount, so that they stay aligned with the
+// convolver output. They may be float or double, the delay
+// line keeps double samples so neither loses precision.
+//
+// Zero latency mode: the first 'quantum' taps of the IR
+// (the head) are run as a direct FIR on the calling thread,
+// Convproc gets the rest of the IR starting from tap 'quantum'.
+// Its delay then lines up exactly with the head, the output is
+// the full convolution without latency and dry is not delayed.
+// Supported for single input convolvers only.
+
+class ConvprocFifo
+{
+public:
+  ConvprocFifo();
+
+  // Must be called after Convproc::start_process() or start_inline()
+  void setup(Convproc *convproc, int ninp, int nout, int quantum, bool sync);
+
+  // Enables zero latency mode, 'ir' - 'quantum' head taps
+  // for output 'out'. Must be called for all outputs
+  // after setup() and before process().
+  void setHead(int out, const float *ir);
+
+  // 'inp' and 'out' may point to the same buffers.
+  // 'dry' - ninp buffers delayed in place.
+  void process(float **inp, float **out, int nframes);
+  void process(float **inp, float **out, float **dry, int nframes);
+  void process(float **inp, float **out, double **dry, int nframes);
+
+  // Delays 'dry' like process() does, but does not run
+  // the convolver. Its state is stale after that.
+  void bypass(float **dry, int nframes);
+  void bypass(double **dry, int nframes);
+
+  int latency() const
+  {
+    return head.empty() ? quantum : 0;
+  }
+
+private:
+  template <typename DryType>
+  void run(float **inp, float **out, DryType **dry, int nframes);
+  template <typename DryType>
+  void skip(DryType **dry, int nframes);
+  template <typename DryType>
+  void delay(DryType **dry, int offset, int n);
+  void applyHead(float **out, int offset, int n);
+
+  Convproc *convproc;
+  int ninp;
+  int nout;
+  int quantum;
+  int fill;
+  bool sync;
+
+  std::vector<double> dryDelay;
+
+  std::vector<float> head;     // nout * quantum taps
+  std::vector<float> history;  // quantum - 1 past + quantum new input samples
+};
+
+#endif
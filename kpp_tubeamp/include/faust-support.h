@@ -22,43 +22,15 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
-#include "kpp_tubeamp.h"
-
-// Defines for compatability with
-// FAUST generated code
-
-#define VOLUME_CTRL ports.volume
-#define DRIVE_CTRL ports.drive
-#define MASTERGAIN_CTRL ports.mastergain
-
-#define AMP_BIAS_CTRL profile->amp_bias
-#define AMP_KREG_CTRL profile->amp_Kreg
-#define AMP_UPOR_CTRL profile->amp_Upor
-
-#define PREAMP_BIAS_CTRL profile->preamp_bias
-#define PREAMP_KREG_CTRL profile->preamp_Kreg
-#define PREAMP_UPOR_CTRL profile->preamp_Upor
-
-#define LOW_CTRL ports.low
-#define MIDDLE_CTRL ports.middle
-#define HIGH_CTRL ports.high
-
-#define LOW_FREQ_CTRL profile->tonestack_low_freq
-#define MIDDLE_FREQ_CTRL profile->tonestack_middle_freq
-#define HIGH_FREQ_CTRL profile->tonestack_high_freq
-
-#define LOW_BAND_CTRL profile->tonestack_low_band
-#define MIDDLE_BAND_CTRL profile->tonestack_middle_band
-#define HIGH_BAND_CTRL profile->tonestack_high_band
-
-#define PREAMP_LEVEL profile->preamp_level
-#define AMP_LEVEL profile->amp_level
-
-#define SAG_TIME profile->sag_time
-#define SAG_COEFF profile->sag_coeff
+// Sample type of FAUST code, double when the plugins
+// are built with KPP_DOUBLE_PRECISION
+#ifndef FAUSTFLOAT
+#define FAUSTFLOAT float
+#endif
 
-#define OUTPUT_LEVEL profile->output_level
+#include "profile.h"
 
 // Needed for compatability with FAUST generated code
 struct Meta : std::map<const char*, const char*>
@@ -77,23 +49,107 @@ struct Meta : std::map<const char*, const char*>
 };
 
 
+// Controls of the FAUST code that are set from
+// *.tapf profile parameters, by label
+static const struct
+{
+  const char *label;
+  float st_profile_header::*field;
+} profileControls[] = {
+  {"preamp_level", &st_profile_header::preamp_level},
+  {"preamp_bias", &st_profile_header::preamp_bias},
+  {"preamp_Kreg", &st_profile_header::preamp_Kreg},
+  {"preamp_Upor", &st_profile_header::preamp_Upor},
+  {"amp_level", &st_profile_header::amp_level},
+  {"amp_bias", &st_profile_header::amp_bias},
+  {"amp_Kreg", &st_profile_header::amp_Kreg},
+  {"amp_Upor", &st_profile_header::amp_Upor},
+  {"sag_time", &st_profile_header::sag_time},
+  {"sag_coeff", &st_profile_header::sag_coeff},
+  {"output_level", &st_profile_header::output_level}
+};
+
+static const int numProfileControls = sizeof(profileControls) / sizeof(profileControls[0]);
+
+
+// Binds plugin parameters to FAUST controls by label.
+// The FAUST code is split into several DSP classes (see
+// the *.dsp file), a control used by more than one of them
+// gets a pointer from each buildUserInterface() call.
 class UI {
 public:
    UI(){};
 
   void openVerticalBox(const char * name) {};
+  void addCheckButton(std::string label, FAUSTFLOAT *fValue) {};
+  void addHorizontalSlider(std::string label, FAUSTFLOAT *fValue, float minValue, float maxValue, float defaultValue, float step) {
+    if (label == std::string("drive"))
+    {
+      driveValues.push_back(fValue);
+    }
+
+    if (label == std::string("volume"))
+    {
+      volumeValues.push_back(fValue);
+    }
+
+    if (label == std::string("mastergain"))
+    {
+      mastergainValues.push_back(fValue);
+    }
+  }
+  void addNumEntry(std::string label, FAUSTFLOAT *fValue, float minValue, float maxValue, float defaultValue, float step) {
+    for (int i = 0; i < numProfileControls; i++)
+    {
+      if (label == std::string(profileControls[i].label))
+      {
+        profileValues[i].push_back(fValue);
+      }
+    }
+  }
+
   void closeBox() {};
 
+  void setDriveValue(float value)
+  {
+    setValues(driveValues, value);
+  }
+  void setVolumeValue(float value)
+  {
+    setValues(volumeValues, value);
+  }
+  void setMastergainValue(float value)
+  {
+    setValues(mastergainValues, value);
+  }
+
+  // Copies all model parameters of the profile
+  void setProfile(const st_profile_header &profile)
+  {
+    for (int i = 0; i < numProfileControls; i++)
+    {
+      setValues(profileValues[i], profile.*profileControls[i].field);
+    }
+  }
+private:
+  static void setValues(const std::vector<FAUSTFLOAT*> &values, float value)
+  {
+    for (FAUSTFLOAT *v : values)
+    {
+      *v = value;
+    }
+  }
+
+  std::vector<FAUSTFLOAT*> driveValues;
+  std::vector<FAUSTFLOAT*> volumeValues;
+  std::vector<FAUSTFLOAT*> mastergainValues;
+  std::vector<FAUSTFLOAT*> profileValues[numProfileControls];
 };
 
 
 class dsp {
 
     public:
-
-        stPorts ports;
-        st_profile_header *profile;
-
         dsp() {}
         virtual ~dsp() {}
 
@@ -165,7 +221,7 @@ class dsp {
          * @param outputs - the output audio buffers as an array of non-interleaved FAUSTFLOAT samples (eiher float, double or quad)
          *
          */
-        virtual void compute(int count, float** inputs, float** outputs) = 0;
+        virtual void compute(int count, FAUSTFLOAT** inputs, FAUSTFLOAT** outputs) = 0;
 
         /**
          * DSP instance computation: alternative method to be used by subclasses.
@@ -176,7 +232,7 @@ class dsp {
          * @param outputs - the output audio buffers as an array of non-interleaved FAUSTFLOAT samples (eiher float, double or quad)
          *
          */
-        virtual void compute(double date_usec, int count, float** inputs, float** outputs) { compute(count, inputs, outputs); }
+        virtual void compute(double date_usec, int count, FAUSTFLOAT** inputs, FAUSTFLOAT** outputs) { compute(count, inputs, outputs); }
 
 };
 
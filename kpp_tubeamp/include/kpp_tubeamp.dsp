@@ -29,7 +29,7 @@
  *
  * Distortion and tonestack parameters loaded
  * from *.tapf profile file.
- * Convolvers work outside this FAUST module.
+ * Convolvers and the tonestack work outside this FAUST module.
  * Cabsym convolver may be bypassed.
  */
 
@@ -39,66 +39,97 @@ declare license "GPLv3";
 declare version "1.2";
 
 import("stdfaust.lib");
+kt = library("kpp_tube.lib");
 
-process = preamp_amp with {
+// The chain is split into four parts, each one is a separate
+// DSP class. Only the tubes and everything between them run
+// at the oversampled rate, linear parts before and after
+// them run at the host rate. The tonestack between the preamp
+// and the power amp is Tonestack (see tonestack.h), run by
+// the plugin between the second and the third part.
 
-    // Link parameters from *.tapf profile file
-    // and knob values with FAUST code.
-    drive = fvariable(float DRIVE_CTRL, <math.h>);
-    volume = fvariable(float VOLUME_CTRL, <math.h>);
-    mastergain = fvariable(float MASTERGAIN_CTRL, <math.h>);
+// Preamp tube, before the tonestack
+process = tubeamp(0, 1);
+
+// Power amp tubes and Voltage Sag, after the tonestack
+process_amp = tubeamp(0, 2);
+
+// The same with table based tubes and Voltage Sag
+// divider, used for realtime processing when enabled
+process_fast = tubeamp(1, 1);
+process_fast_amp = tubeamp(1, 2);
+
+// The same with anti-aliased tubes,
+// used when Anti-aliasing is enabled
+process_adaa = tubeamp(2, 1);
+process_adaa_amp = tubeamp(2, 2);
+
+// Input gain, before the tubes
+process_pre = tubeamp(0, 0);
+
+// Output gain, after the tubes
+process_post = tubeamp(0, 3);
+
+// mode - 0 exact tubes, 1 table based tubes, 2 anti-aliased tubes
+// part - 0 input gain, 1 preamp, 2 power amp and Voltage Sag,
+// 3 output gain
+tubeamp(mode, part) = tubeamp_part(part) with {
+
+    // Knobs and *.tapf profile parameters are FAUST controls,
+    // set by the plugin through UI (see faust-support.h).
+    // Everything computed from them alone is evaluated
+    // once per compute() call instead of every sample.
+
+    // Profile parameter, its range is not checked
+    profile(name, init) = nentry(name, init, -1e6, 1e6, 0.000001);
+
+    // Gain ramp of knobs that scale the signal, removes zipper noise
+    smooth = si.smoo;
+
+    drive = hslider("drive", 50, 0, 100, 0.01);
+    volume = hslider("volume", 0.5, 0, 1, 0.001);
+    mastergain = hslider("mastergain", 50, 0, 100, 0.01);
 
     // Bias signal before distortion
-    amp_bias = fvariable(float AMP_BIAS_CTRL, <math.h>);
+    amp_bias = profile("amp_bias", 0);
     // Threshold of distortion
-    amp_Upor = fvariable(float AMP_UPOR_CTRL, <math.h>);
+    amp_Upor = profile("amp_Upor", 1);
     // Severity/softness of distortion
-    amp_Kreg = fvariable(float AMP_KREG_CTRL, <math.h>);
+    amp_Kreg = profile("amp_Kreg", 1);
 
     // The same parameters for preamp
-    preamp_bias = fvariable(float PREAMP_BIAS_CTRL, <math.h>);
-    preamp_Upor = fvariable(float PREAMP_UPOR_CTRL, <math.h>);
-    preamp_Kreg = fvariable(float PREAMP_KREG_CTRL, <math.h>);
+    preamp_bias = profile("preamp_bias", 0);
+    preamp_Upor = profile("preamp_Upor", 1);
+    preamp_Kreg = profile("preamp_Kreg", 1);
 
 
-    tonestack_low = fvariable(float LOW_CTRL, <math.h>);
-    tonestack_middle = fvariable(float MIDDLE_CTRL, <math.h>);
-    tonestack_high = fvariable(float HIGH_CTRL, <math.h>);
-
-    tonestack_low_freq = fvariable(float LOW_FREQ_CTRL, <math.h>);
-    tonestack_middle_freq = fvariable(float MIDDLE_FREQ_CTRL, <math.h>);
-    tonestack_high_freq = fvariable(float HIGH_FREQ_CTRL, <math.h>);
-
-    tonestack_low_band = fvariable(float LOW_BAND_CTRL, <math.h>);
-    tonestack_middle_band = fvariable(float MIDDLE_BAND_CTRL, <math.h>);
-    tonestack_high_band = fvariable(float HIGH_BAND_CTRL, <math.h>);
-
     // Gain before preamp
-    preamp_level = fvariable(float PREAMP_LEVEL, <math.h>);
+    preamp_level = profile("preamp_level", 1);
     // Gain before amp
-    amp_level = fvariable(float AMP_LEVEL, <math.h>);
+    amp_level = profile("amp_level", 1);
 
     // Voltage Sag parameters
-    sag_time = fvariable(float SAG_TIME, <math.h>);
-    sag_coeff = fvariable(float SAG_COEFF, <math.h>);
+    sag_time = profile("sag_time", 3);
+    sag_coeff = profile("sag_coeff", 1);
 
     // Output gain
-    output_level = fvariable(float OUTPUT_LEVEL, <math.h>);
+    output_level = profile("output_level", 1);
 
-    // Model of tube nonlinear distortion
-    tube(Kreg,Upor,bias,cut) = main : +(bias) : max(cut) with {
-        Ks(x) = 1/(max((x-Upor)*(Kreg),0)+1);
-        Ksplus(x) = Upor - x*Upor;
-        main(Uin) = (Uin * Ks(Uin) + Ksplus(Ks(Uin)));
+    // Model of tube nonlinear distortion, see kpp_tube.lib
+    tube(Kreg,Upor,bias,cut) = tube_mode(mode) with {
+        tube_mode(0) = kt.tube(Kreg,Upor,bias,cut);
+        tube_mode(1) = kt.tube_fast(Kreg,Upor,bias,cut);
+        tube_mode(2) = kt.tube_adaa(Kreg,Upor,bias,cut);
     };
 
-    // Preamp - has 1 class A tube distortion (non symmetric)
-    stage_preamp = fi.lowpass(1,11000) :
-    tube(preamp_Kreg,preamp_Upor,preamp_bias,-preamp_Upor);
+    // Divider of Voltage Sag, its input is in [1, 2.5]
+    sag_divide = divide_mode(mode) with {
+        divide_mode(1) = kt.recip_fast;
+        divide_mode(m) = 1.0/_;
+    };
 
-    stage_tonestack = fi.peak_eq(tonestack_low,tonestack_low_freq,tonestack_low_band) :
-    fi.peak_eq(tonestack_middle,tonestack_middle_freq,tonestack_middle_band) :
-    fi.peak_eq(tonestack_high,tonestack_high_freq,tonestack_high_band): fi.lowpass(1,11000);
+    // Preamp - has 1 class A tube distortion (non symmetric)
+    stage_preamp = tube(preamp_Kreg,preamp_Upor,preamp_bias,-preamp_Upor);
 
     // Power Amp - has 1 class B tube distortion (symmetric)
     stage_amp = _<: _,*(-1.0) :
@@ -107,17 +138,26 @@ process = preamp_amp with {
     - :
     fi.lowpass(1, 11000);
 
-    // Part of the chain before Voltage Sag in power amp
-    pre_sag = _,_ : + : fi.dcblocker : *(ba.db2linear(drive * 0.4) - 1) :
-    *(preamp_level) : stage_preamp : fi.dcblocker :*(amp_level) :
-    *(ba.db2linear(mastergain * 0.4) - 1) : stage_tonestack;
+    // Input gain and the preamp input filter
+    input_gain = *(2.0) : fi.dcblocker : *((ba.db2linear(drive * 0.4) - 1) : smooth) :
+    *(preamp_level) : fi.lowpass(1,11000);
+
+    // Part of the chain before the tonestack
+    preamp = stage_preamp : fi.dcblocker :*(amp_level) :
+    *((ba.db2linear(mastergain * 0.4) - 1) : smooth);
 
-    // All chain, pre-sag + power amp with Voltage Sag
-    preamp_amp = pre_sag :
-    (_,_ : (_<: (1.0/_),_),_ : _,* : _,stage_amp : *)
+    // Tonestack output filter + power amp with Voltage Sag
+    amp = fi.lowpass(1,11000) :
+    (_,_ : (_<: sag_divide,_),_ : _,* : _,stage_amp : *)
     ~ (_ <: _,_: * : fi.lowpass(1,sag_time) : *(sag_coeff) :
-    max(1.0) : min(2.5)) : *(volume) :
-    *(output_level) : fi.dcblocker <: _,_;
+    max(1.0) : min(2.5));
+
+    output_gain = *(volume : smooth) : *(output_level) : fi.dcblocker;
+
+    tubeamp_part(0) = input_gain;
+    tubeamp_part(1) = preamp;
+    tubeamp_part(2) = amp;
+    tubeamp_part(3) = output_gain;
 };
 
 
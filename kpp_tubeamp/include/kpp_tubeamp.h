@@ -1,43 +0,0 @@
-/*
- * Copyright (C) 2018-2020 Oleg Kapitonov
- *
- * This program is free software; you can redistribute it and/or modify
- * it under the terms of the GNU General Public License as published by
- * the Free Software Foundation; either version 3 of the License, or
- * (at your option) any later version.
- *
- * This program is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License
- * along with this program; if not, write to the Free Software
- * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
- * --------------------------------------------------------------------------
- */
-
-
-#ifndef KPP_TUBEAMP_H
-#define KPP_TUBEAMP_H
-
-#include <map>
-#include <string>
-
-#include "profile.h"
-
-// Structure holds pointers
-// to LV2 plugin ports
-struct stPorts
-{
-  float volume;
-  float drive;
-  float low;
-  float middle;
-  float high;
-  float mastergain;
-  float cabinet;
-};
-
-
-#endif
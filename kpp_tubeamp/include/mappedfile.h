@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Read-only memory mapping of a whole file.
+// The mapping is released with the object.
+class MappedFile
+{
+public:
+
+  MappedFile() {}
+
+  ~MappedFile()
+  {
+    close();
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Empty files are not mapped
+  bool open(const char *path)
+  {
+    close();
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0))
+    {
+      void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED)
+      {
+        mData = (const char *)map;
+        mSize = st.st_size;
+      }
+    }
+
+    // Mapping stays valid without the descriptor
+    ::close(fd);
+    return mData != nullptr;
+  }
+
+  void close()
+  {
+    if (mData)
+    {
+      munmap((void *)mData, mSize);
+      mData = nullptr;
+      mSize = 0;
+    }
+  }
+
+  const char *data() const
+  {
+    return mData;
+  }
+
+  size_t size() const
+  {
+    return mSize;
+  }
+
+private:
+
+  const char *mData = nullptr;
+  size_t mSize = 0;
+};
+
+#endif
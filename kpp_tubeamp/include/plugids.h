@@ -59,7 +59,18 @@ namespace Vst {
     kTrebleId = 104,
     kVolumeId = 105,
     kLevelId = 106,
-    kCabinetId = 107
+    kCabinetId = 107,
+    kZeroLatencyId = 108,
+
+    // Applied on activation, change latency
+    kOversamplingId = 109,
+    kOfflineQualityId = 110,
+
+    // Anti-aliased tubes
+    kAntiAliasingId = 111,
+
+    // Table based tubes in realtime, applied on activation
+    kFastTubesId = 112
   };
 
 
@@ -50,12 +50,33 @@
 #include "public.sdk/source/vst/vstaudioeffect.h"
 
 #include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "faust-support.h"
+#include "../../common/include/paramautomation.h"
+#include "../../common/include/alignedbuffer.h"
+#include "../../common/include/silencedetector.h"
+#include "../../common/include/oversampler.h"
+#include "../../common/include/bypassdelay.h"
+#include "../../common/include/tonestack.h"
 #include "kpp_tubeamp_dsp.h"
+#include "kpp_tubeamp_fast_dsp.h"
+#include "kpp_tubeamp_adaa_dsp.h"
+#include "kpp_tubeamp_amp_dsp.h"
+#include "kpp_tubeamp_fast_amp_dsp.h"
+#include "kpp_tubeamp_adaa_amp_dsp.h"
+#include "kpp_tubeamp_pre_dsp.h"
+#include "kpp_tubeamp_post_dsp.h"
 
 
 struct stProfile;
+struct ProfileImpulses;
+class TapfFile;
 
 namespace Steinberg {
 namespace Vst {
@@ -67,10 +88,14 @@ namespace Vst {
 
     tresult PLUGIN_API initialize (FUnknown* context) SMTG_OVERRIDE;
     tresult receiveText (const char* text) SMTG_OVERRIDE;
+    tresult PLUGIN_API notify (IMessage* message) SMTG_OVERRIDE;
     tresult PLUGIN_API setBusArrangements (Vst::SpeakerArrangement* inputs, int32 numIns,
                                            Vst::SpeakerArrangement* outputs,
                                            int32 numOuts) SMTG_OVERRIDE;
 
+                                           uint32 PLUGIN_API getLatencySamples () SMTG_OVERRIDE;
+                                           uint32 PLUGIN_API getTailSamples () SMTG_OVERRIDE;
+                                           tresult PLUGIN_API canProcessSampleSize (int32 symbolicSampleSize) SMTG_OVERRIDE;
                                            tresult PLUGIN_API setupProcessing (Vst::ProcessSetup& setup) SMTG_OVERRIDE;
                                            tresult PLUGIN_API setActive (TBool state) SMTG_OVERRIDE;
                                            tresult PLUGIN_API process (Vst::ProcessData& data) SMTG_OVERRIDE;
@@ -85,10 +110,78 @@ namespace Vst {
 
     bool check_profile_file(const char *path);
     stProfile* load_profile(const char *path);
+    std::shared_ptr<const ProfileImpulses> prepare_impulses(
+      const TapfFile &file, unsigned int head, bool fullLength);
+
+    // Background profile loader. Profiles are built
+    // on the loader thread and handed to the audio thread
+    // through pendingProfile, the profile replaced by
+    // the audio thread comes back through retiredProfile
+    // and is deleted on the loader thread.
+    void startLoader();
+    void stopLoader();
+    void requestProfile(const std::string &path);
+    void loaderMain();
+    void collectRetiredProfile();
+
+    // Offline renders do not run ahead of the loader,
+    // a requested profile is taken by the next block
+    void waitLoader();
 
     void setBufsize(int size);
+    template <typename SampleType>
+    void processAudio (Vst::ProcessData& data, SampleType **in, SampleType **out);
+
+    template <typename SampleType>
+    void processBlock (SampleType **inputs, int32 numInputs, SampleType **outputs,
+                       int32 start, int32 end);
+
+    void setParameter (Vst::ParamID id, Vst::ParamValue value);
+
+    // Settings used only by setActive(). They come from
+    // process() and from the controller, see settingsmessage.h
+    void setActivationSetting (Vst::ParamID id, Vst::ParamValue value);
+    bool settingsApplied ();
+    int oversamplingFactor (bool offlineQuality);
+
+    void applyAutomation (int32 offset);
+
+    Vst::ParamAutomation automation;
+
+    // Convolvers and FAUST code sleep after the input
+    // has been silent longer than the tail of the chain
+    void updateTail();
+    Vst::SilenceDetector silence;
+    std::atomic<uint32> tailSamples {0};
+
+    // Latency of the profile in use
+    void updateLatency();
+    std::atomic<uint32> latencySamples {0};
+
+    // Copies the model of the profile to FAUST code and the tonestack
+    void setProfile(const st_profile_header &header);
+
+    // Preamp and power amp: TubeampDsp and TubeampAmpDsp,
+    // their Fast variants in realtime with fast tubes
+    // or Adaa variants with anti-aliasing
+    enum TubeModel
+    {
+      kTubesExact,
+      kTubesFast,
+      kTubesAdaa
+    };
+    TubeModel selectTubeModel (bool offline);
+    ::dsp *dsp = nullptr;
+    ::dsp *ampDsp = nullptr;
+    TubeModel tubeModel = kTubesExact;
+
+    // Bass, middle and treble between dsp and ampDsp
+    Tonestack<FAUSTFLOAT> tonestack;
 
-    TubeampDsp *dsp = nullptr;
+    // Linear parts before and after the oversampled section
+    TubeampPreDsp *preDsp = nullptr;
+    TubeampPostDsp *postDsp = nullptr;
+    UI *ui = nullptr;
 
     float sampleRate;
 
@@ -101,17 +194,76 @@ namespace Vst {
     ParamValue mCabinet = 0;
     bool mBypass = false;
 
-    stProfile *profile = nullptr;
+    // Activation settings, also written by notify()
+    std::atomic<bool> mZeroLatency {false};
+    std::atomic<ParamValue> mOversampling {0};
+    std::atomic<bool> mOfflineQuality {false};
+    std::atomic<bool> mFastTubes {false};
+    std::atomic<bool> mAntiAliasing {false};
+
+    // Mode used by load_profile(), set by setActive().
+    // Offline renders run convolvers without threads,
+    // with offline quality cabinet IRs are not trimmed.
+    std::atomic<bool> zeroLatencyMode {false};
+    std::atomic<bool> offlineMode {false};
+    std::atomic<bool> fullImpulses {false};
+
+    stProfile *profile = nullptr;    // Owned by the audio thread while active
+
+    std::atomic<stProfile*> pendingProfile {nullptr};
+    std::atomic<stProfile*> retiredProfile {nullptr};
+
+    std::thread loaderThread;
+    std::mutex loaderMutex;
+    std::condition_variable loaderCond;
+    std::condition_variable loaderIdle;
+    std::string loaderRequest;
+    bool loaderHasRequest = false;
+    bool loaderBusy = false;
+    bool loaderQuit = false;
 
     std::string profilePath;
 
-    int32_t bufsize = 8192;
+    // Output bus channels, 1 or 2. The cabinet convolver
+    // has no more outputs than this.
+    // Set by setActive() before any profile is loaded.
+    int cabinetChannels = 2;
+
+    // Last applied cabinet mix and pre-roll counters (in samples)
+    // used when processBlock() leaves its endpoint fast paths
+    float cabinetMix = 1.0;
+    int32 cabinetPreroll = 0;
+    int32 dryPreroll = 0;
+
+    // Size of scratch buffers, taken from ProcessSetup::maxSamplesPerBlock.
+    // Longer blocks are split by process().
+    int32_t bufsize = 0;
+    static const int32_t maxBufsize = 2048;
+
+    AlignedBuffer<float> scratch;  // Memory for all float buffers below
+
+    float *preamp_inp_buf = nullptr;  // Buffers for preamp convolver
+    float *preamp_outp_buf = nullptr;
+
+    // Cabinet convolver buffers, used when host samples are not float
+    float *cabinet_buf[2] = {nullptr, nullptr};
+
+    // FAUST input and output, used when host
+    // or convolver samples are not FAUSTFLOAT
+    AlignedBuffer<FAUSTFLOAT> faustScratch;
+    FAUSTFLOAT *faust_inp_buf = nullptr;
+    FAUSTFLOAT *faust_outp_buf = nullptr;
+
+    // Buffer for cabinet simulation bypass, keeps FAUST precision
+    FAUSTFLOAT *drybuf = nullptr;
 
-    std::vector<float> drybuf_l;     // Buffers for cabinet simulation bypass
-    std::vector<float> drybuf_r;
+    // Nonlinear FAUST section runs at 'factor' times the host rate,
+    // between the preamp and cabinet convolvers
+    Oversampler oversampler;
+    AlignedBuffer<FAUSTFLOAT> faustHigh;  // Oversampled FAUST input/output
 
-    std::vector<float> preamp_inp_buf;  // Buffers for preamp convolver
-    std::vector<float> preamp_outp_buf;
+    // Bypassed signal is delayed by the latency of the chain
+    BypassDelay bypass;
   };
 
   //------------------------------------------------------------------------
@@ -63,4 +63,30 @@ typedef struct {
     int sample_count;
 }st_impulse_header;
 
+// Version 2 chunk table, follows
+// the cabinet IRs. Its impulse header
+// has channel -1, older readers skip
+// the table as an unknown IR.
+
+typedef struct {
+    st_impulse_header impulse;  // sample_count - table size in floats
+    char signature[4];          // "TaPc"
+    uint32_t chunk_count;
+    uint32_t reserved;
+    uint64_t content_hash;      // Whole file without these 8 bytes
+}st_chunk_table_header;
+
+// Entry of the chunk table, IR
+// pre-rendered at 'sample_rate'
+
+typedef struct {
+    uint32_t type;              // 0 - preamp, 1 - cabinet
+    uint32_t sample_rate;
+    uint32_t channel;           // Cabinet IRs, 0 - left, 1 - right
+    uint32_t sample_count;
+    uint32_t trimmed_count;     // Without the tail below 'trim_db', 0 - unknown
+    float trim_db;
+    uint64_t offset;            // Of the samples from the file start
+}st_impulse_chunk;
+
 #endif
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef PROFILECACHE_H
+#define PROFILECACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef HAVE_STRUCT_TIMESPEC
+#define HAVE_STRUCT_TIMESPEC
+#endif
+#include "../thirdparty/zita-convolver/zita-convolver.h"
+#include "profile.h"
+
+// Convolver data of a profile prepared for one sample rate
+// and partition plan. Convolvers of all instances link to its
+// IR partitions with Convproc::impdata_link(), so the file
+// is parsed and resampled and the partitions are transformed
+// once per process. Never modified after it is cached.
+struct ProfileImpulses
+{
+  st_profile_header header;
+
+  // Configured and filled with the IRs, never started.
+  // Cabinet has one output per IR.
+  Convproc preamp;
+  Convproc cabinet;
+
+  unsigned int preampSize;     // Convolver lengths, without the heads
+  unsigned int cabinetSize;
+  int cabinetOutputs;
+  int preampLength;            // IR lengths in samples
+  int cabinetLength;
+
+  // Zero latency mode: first 'quantum' taps of the IRs,
+  // run as direct FIRs by ConvprocFifo
+  std::vector<float> preampHead;
+  std::vector<float> cabinetHead[2];
+};
+
+// Process-wide cache of ProfileImpulses.
+//
+// Entries are shared by the profiles that use them and are
+// deleted with the last one, the cache keeps weak references.
+// The partition plan follows from the IR lengths, so the
+// file contents and the convolver settings identify it.
+//
+// Entries are also stored in $XDG_CACHE_HOME/kpp (~/.cache/kpp),
+// one file per key. A changed profile has another hash and
+// so another file. Cache files hold FFTW output and are
+// specific to the machine. Files of another cache version
+// are deleted, and the least recently used ones when the
+// directory grows too large or they have not been used
+// for a long time.
+class ProfileCache
+{
+public:
+
+  struct Key
+  {
+    uint64_t hash;         // Profile file contents
+    uint64_t size;
+    float sampleRate;
+    int quantum;           // Convolver quantum and smallest partition
+    int head;              // Taps run as direct FIRs
+    int cabinetChannels;   // Cabinet IRs are mixed for one channel
+    bool fullImpulses;     // Cabinet IR tail is not trimmed
+
+    bool operator<(const Key &other) const;
+  };
+
+  // 64-bit FNV-1a
+  static uint64_t hash(const void *data, size_t size);
+
+  static std::shared_ptr<const ProfileImpulses> find(const Key &key);
+
+  // Returns the entry cached for 'key' meanwhile,
+  // when another instance was quicker
+  static std::shared_ptr<const ProfileImpulses> insert(const Key &key,
+    std::shared_ptr<const ProfileImpulses> impulses);
+
+  // Reads the cache file of 'key', its IR partitions are
+  // copied to the convolvers without any FFT. Returns
+  // nullptr when there is no valid file.
+  static std::shared_ptr<const ProfileImpulses> load(const Key &key);
+
+  // Writes the cache file of 'key' and evicts old files,
+  // errors are ignored
+  static void store(const Key &key, const ProfileImpulses &impulses);
+
+private:
+
+  static std::string cacheDir(bool create);
+  static std::string cachePath(const Key &key, bool create);
+
+  // Deletes stale files in 'dir' and trims it, 'keep'
+  // is the file just stored
+  static void evict(const std::string &dir, const std::string &keep);
+
+  static std::mutex mutex;
+  static std::map<Key, std::weak_ptr<const ProfileImpulses>> entries;
+};
+
+#endif
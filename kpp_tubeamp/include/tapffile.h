@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef TAPFFILE_H
+#define TAPFFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "mappedfile.h"
+#include "profile.h"
+
+// Read-only view of a *.tapf profile file.
+//
+//   st_profile_header
+//   st_impulse_header + samples   preamp IR, 48000 Hz
+//   st_impulse_header + samples   cabinet IR, channel 0 or 1
+//   st_impulse_header + samples   optional second cabinet IR
+//
+// Version 2 files go on with st_chunk_table_header, the table
+// entries and their samples. Chunks carry the IRs pre-rendered
+// at other rates, so that loading needs no resampling.
+// Readers of version 1 stop before the table or skip it.
+//
+// open() maps the whole file and checks it up front:
+// the version, all headers and that all IR samples lie
+// inside the file. IRs are then used in place, no sample
+// is read or copied before it is needed.
+class TapfFile
+{
+public:
+
+  enum
+  {
+    kVersion = 2
+  };
+
+  // IR samples inside the mapping
+  struct Impulse
+  {
+    const float *data = nullptr;
+    size_t count = 0;
+    size_t trimmed = 0;    // Length without the tail below 'trimDb', 0 - unknown
+    float trimDb = 0.0;
+  };
+
+  bool open(const char *path);
+
+  // Whole file contents
+  const char *data() const
+  {
+    return file.data();
+  }
+
+  size_t size() const
+  {
+    return file.size();
+  }
+
+  const st_profile_header &header() const
+  {
+    return mHeader;
+  }
+
+  const Impulse &preamp() const
+  {
+    return mPreamp;
+  }
+
+  // 48000 Hz cabinet IR for 'channel', 0 - left, 1 - right.
+  // Profiles with one cabinet IR give it for both.
+  const Impulse &cabinet(int channel) const
+  {
+    return mCabinet[channel];
+  }
+
+  // Stored by version 2 files, 0 - none
+  uint64_t contentHash() const
+  {
+    return mContentHash;
+  }
+
+  // Compares the contents with contentHash(). Reads
+  // the whole file, files without the hash pass.
+  bool verify() const;
+
+  // IRs pre-rendered at 'sampleRate'. False when
+  // the file has no preamp and cabinet IRs for it.
+  bool rendered(float sampleRate, Impulse &preamp, Impulse cabinet[2]) const;
+
+  // FNV-1a, 'h' continues an earlier hash
+  static uint64_t hash(const void *data, size_t size,
+                       uint64_t h = 14695981039346656037ull);
+
+  // Resamples 'channels' (1 or 2) 48000 Hz IRs of 'count' samples
+  // to 'sampleRate' and keeps their gain. Each of 'resampled'
+  // gets resampledCount() samples.
+  static void resample(const float *const *impulses, int channels, size_t count,
+                       float sampleRate, float *const *resampled);
+  static size_t resampledCount(size_t count, float sampleRate);
+
+  // IR length without the tail whose energy is below
+  // 'thresholdDb' relative to the whole IR energy
+  static size_t trimmedLength(const float *impulse, size_t count, double thresholdDb);
+
+private:
+
+  struct Chunk
+  {
+    uint32_t type;
+    uint32_t sampleRate;
+    uint32_t channel;
+    Impulse impulse;
+  };
+
+  bool parse();
+  bool readImpulse(size_t &pos, Impulse &impulse, int &channel);
+  bool readTable(size_t pos);
+
+  MappedFile file;
+  st_profile_header mHeader;
+  Impulse mPreamp;
+  Impulse mCabinet[2];
+
+  std::vector<Chunk> chunks;
+  uint64_t mContentHash = 0;
+  size_t hashPos = 0;
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#include "../include/convprocfifo.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+ConvprocFifo::ConvprocFifo() :
+  convproc(nullptr),
+  ninp(0),
+  nout(0),
+  quantum(0),
+  fill(0),
+  sync(true)
+{
+}
+
+void ConvprocFifo::setup(Convproc *convproc, int ninp, int nout, int quantum, bool sync)
+{
+  this->convproc = convproc;
+  this->ninp = ninp;
+  this->nout = nout;
+  this->quantum = quantum;
+  this->sync = sync;
+  fill = 0;
+
+  dryDelay.assign(ninp * quantum, 0.0);
+  head.clear();
+  history.clear();
+}
+
+void ConvprocFifo::setHead(int out, const float *ir)
+{
+  if (head.empty())
+  {
+    head.assign(nout * quantum, 0.0f);
+    history.assign(2 * quantum - 1, 0.0f);
+  }
+
+  memcpy(head.data() + out * quantum, ir, quantum * sizeof(float));
+}
+
+void ConvprocFifo::process(float **inp, float **out, int nframes)
+{
+  run<float>(inp, out, nullptr, nframes);
+}
+
+void ConvprocFifo::process(float **inp, float **out, float **dry, int nframes)
+{
+  run(inp, out, dry, nframes);
+}
+
+void ConvprocFifo::process(float **inp, float **out, double **dry, int nframes)
+{
+  run(inp, out, dry, nframes);
+}
+
+void ConvprocFifo::bypass(float **dry, int nframes)
+{
+  skip(dry, nframes);
+}
+
+void ConvprocFifo::bypass(double **dry, int nframes)
+{
+  skip(dry, nframes);
+}
+
+template <typename DryType>
+void ConvprocFifo::run(float **inp, float **out, DryType **dry, int nframes)
+{
+  int done = 0;
+
+  while (done < nframes)
+  {
+    int n = quantum - fill;
+    if (n > nframes - done)
+    {
+      n = nframes - done;
+    }
+
+    // All inputs are taken before outputs are written,
+    // so in-place processing is safe
+    for (int c = 0; c < ninp; c++)
+    {
+      memcpy(convproc->inpdata(c) + fill, inp[c] + done, n * sizeof(float));
+    }
+    if (!head.empty())
+    {
+      memcpy(history.data() + quantum - 1, inp[0] + done, n * sizeof(float));
+    }
+
+    for (int c = 0; c < nout; c++)
+    {
+      memcpy(out[c] + done, convproc->outdata(c) + fill, n * sizeof(float));
+    }
+
+    if (!head.empty())
+    {
+      applyHead(out, done, n);
+    }
+    else if (dry)
+    {
+      delay(dry, done, n);
+    }
+
+    fill += n;
+    done += n;
+
+    if (fill == quantum)
+    {
+      convproc->process(sync);
+      fill = 0;
+    }
+  }
+}
+
+template <typename DryType>
+void ConvprocFifo::skip(DryType **dry, int nframes)
+{
+  int done = 0;
+
+  while (done < nframes)
+  {
+    int n = quantum - fill;
+    if (n > nframes - done)
+    {
+      n = nframes - done;
+    }
+
+    if (!head.empty())
+    {
+      // Head history is kept up to date, dry is not delayed
+      std::copy(dry[0] + done, dry[0] + done + n, history.data() + quantum - 1);
+      memmove(history.data(), history.data() + n, (quantum - 1) * sizeof(float));
+    }
+    else
+    {
+      delay(dry, done, n);
+    }
+
+    fill += n;
+    done += n;
+
+    if (fill == quantum)
+    {
+      fill = 0;
+    }
+  }
+}
+
+// Swaps 'n' samples of dry buffers at 'offset'
+// with the delay line at the current fill position
+template <typename DryType>
+void ConvprocFifo::delay(DryType **dry, int offset, int n)
+{
+  for (int c = 0; c < ninp; c++)
+  {
+    double *line = dryDelay.data() + c * quantum + fill;
+    DryType *buf = dry[c] + offset;
+    for (int i = 0; i < n; i++)
+    {
+      double tmp = line[i];
+      line[i] = buf[i];
+      buf[i] = tmp;
+    }
+  }
+}
+
+// Adds the head FIR output for 'n' new samples
+// stored in the history, then drops them from it
+void ConvprocFifo::applyHead(float **out, int offset, int n)
+{
+  const float *x = history.data() + quantum - 1;
+
+  for (int c = 0; c < nout; c++)
+  {
+    const float *h = head.data() + c * quantum;
+    float *buf = out[c] + offset;
+    for (int i = 0; i < n; i++)
+    {
+      float sum = 0.0f;
+      for (int k = 0; k < quantum; k++)
+      {
+        sum += h[k] * x[i - k];
+      }
+      buf[i] += sum;
+    }
+  }
+
+  memmove(history.data(), history.data() + n, (quantum - 1) * sizeof(float));
+}
@@ -43,6 +43,7 @@
 #include "pluginterfaces/base/ibstream.h"
 
 #include "../include/pluguimessagecontroller.h"
+#include "../../common/include/settingsmessage.h"
 
 using namespace VSTGUI;
 
@@ -165,6 +166,33 @@ namespace Vst {
       parameters.addParameter (STR16 ("Cabinet"), NULL, 0, 1.0,
                                ParameterInfo::kCanAutomate, kCabinetId, 0,
                                STR16 ("Cabinet"));
+
+      // Changes latency, so not automatable
+      parameters.addParameter (STR16 ("Zero Latency"), nullptr, 1, 0,
+                               ParameterInfo::kNoFlags, kZeroLatencyId);
+
+      StringListParameter* oversamplingParam =
+        new StringListParameter (STR16 ("Oversampling"), kOversamplingId, nullptr,
+                                 ParameterInfo::kIsList);
+      oversamplingParam->appendString (STR16 ("Off"));
+      oversamplingParam->appendString (STR16 ("2x"));
+      oversamplingParam->appendString (STR16 ("4x"));
+      oversamplingParam->appendString (STR16 ("8x"));
+      parameters.addParameter (oversamplingParam);
+
+      // Offline renders use 8x oversampling with longer filters
+      parameters.addParameter (STR16 ("Offline Quality"), nullptr, 1, 0,
+                               ParameterInfo::kNoFlags, kOfflineQualityId);
+
+      // Antiderivative anti-aliasing of the tubes,
+      // applied on activation, so not automatable
+      parameters.addParameter (STR16 ("Anti-aliasing"), nullptr, 1, 0,
+                               ParameterInfo::kNoFlags, kAntiAliasingId);
+
+      // Realtime processing with table based tubes,
+      // applied on activation, so not automatable
+      parameters.addParameter (STR16 ("Fast Tubes"), nullptr, 1, 0,
+                               ParameterInfo::kNoFlags, kFastTubesId);
     }
     return kResultTrue;
   }
@@ -240,6 +268,37 @@ namespace Vst {
       return kResultFalse;
     setParamNormalized (kBypassId, bypassState ? 1 : 0);
 
+    // Profile path is followed by the zero latency flag and
+    // oversampling settings, all absent in states saved by older versions
+    char8* savedPath = streamer.readStr8 ();
+    if (savedPath)
+      delete[] savedPath;
+
+    int32 zeroLatencyState = 0;
+    if (streamer.readInt32 (zeroLatencyState) == false)
+      zeroLatencyState = 0;
+    setParamNormalized (kZeroLatencyId, zeroLatencyState ? 1 : 0);
+
+    float savedOversampling = 0.f;
+    if (streamer.readFloat (savedOversampling) == false)
+      savedOversampling = 0.f;
+    setParamNormalized (kOversamplingId, savedOversampling);
+
+    int32 offlineQualityState = 0;
+    if (streamer.readInt32 (offlineQualityState) == false)
+      offlineQualityState = 0;
+    setParamNormalized (kOfflineQualityId, offlineQualityState ? 1 : 0);
+
+    int32 antiAliasingState = 0;
+    if (streamer.readInt32 (antiAliasingState) == false)
+      antiAliasingState = 0;
+    setParamNormalized (kAntiAliasingId, antiAliasingState ? 1 : 0);
+
+    int32 fastTubesState = 0;
+    if (streamer.readInt32 (fastTubesState) == false)
+      fastTubesState = 0;
+    setParamNormalized (kFastTubesId, fastTubesState ? 1 : 0);
+
     return kResultOk;
   }
 
@@ -259,10 +318,35 @@ namespace Vst {
 
   tresult PLUGIN_API PlugController::setParamNormalized (ParamID tag, ParamValue value)
   {
+    bool settingChanged = ((tag == kZeroLatencyId) &&
+      ((getParamNormalized (tag) > 0.5) != (value > 0.5))) ||
+      (((tag == kOversamplingId) || (tag == kOfflineQualityId) ||
+        (tag == kAntiAliasingId) || (tag == kFastTubesId)) &&
+      (getParamNormalized (tag) != value));
+
     tresult result = EditControllerEx1::setParamNormalized (tag, value);
+
+    // The processor answers when the component has to be restarted
+    if (settingChanged)
+    {
+      sendSetting (this, tag, value);
+    }
     return result;
   }
 
+  tresult PLUGIN_API PlugController::notify (IMessage* message)
+  {
+    if (isRestart (message))
+    {
+      if (componentHandler)
+      {
+        componentHandler->restartComponent (kLatencyChanged);
+      }
+      return kResultOk;
+    }
+    return EditControllerEx1::notify (message);
+  }
+
   tresult PLUGIN_API PlugController::getParamStringByValue (ParamID tag, ParamValue valueNormalized,
                                                             String128 string)
   {
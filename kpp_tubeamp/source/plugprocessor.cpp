@@ -41,25 +41,118 @@
 #include "pluginterfaces/base/ibstream.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 
-// Zita-convolver parameters
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+// Zita-convolver parameters. Realtime convolvers of all
+// instances share one pool of worker threads, offline
+// renders run all partitions on the audio thread instead.
 #define CONVPROC_SCHEDULER_PRIORITY 0
 #define CONVPROC_SCHEDULER_CLASS SCHED_FIFO
 #define THREAD_SYNC_MODE true
 
 #define fragm 64
 
+// Cabinet IR tail below this level relative to the whole
+// IR energy is cut off. Set to false to use the full IR.
+// Offline renders with offline quality always use it.
+#define CABINET_TAIL_TRIM true
+#define CABINET_TAIL_TRIM_DB -90.0
+
+// Decay time of FAUST code with silent input, in seconds.
+// Slowest parts are the DC blockers (pole 0.995, -120 dB
+// after about 2800 samples), the rest decays much faster.
+#define DSP_TAIL_TIME 0.1
+
 #define HAVE_STRUCT_TIMESPEC
-#include "../thirdparty/zita-resampler/resampler.h"
 #include "../thirdparty/zita-convolver/zita-convolver.h"
+#include "../include/convprocfifo.h"
+#include "../include/profilecache.h"
+#include "../include/tapffile.h"
+#include "../../common/include/sampleconvert.h"
+#include "../../common/include/settingsmessage.h"
 
 struct stProfile
 {
+  // Declared first, so the convolvers linked
+  // to its partitions are deleted before it
+  std::shared_ptr<const ProfileImpulses> impulses;
+
   std::string path;
   st_profile_header header;
   Convproc preamp_convproc;
   Convproc convproc;
+  ConvprocFifo preamp_fifo;
+  ConvprocFifo fifo;
+  int cabinetOutputs;     // 1 when the cabinet convolver is mono
+  int cabinetLength;      // Cabinet IR length in samples
+  bool zeroLatency;       // IR heads run as direct FIRs
+  int preampLength;       // Preamp IR length in samples
+};
+
+// Trimmed length stored by a version 2 profile,
+// 0 when it is unknown for CABINET_TAIL_TRIM_DB
+static size_t stored_trim(const TapfFile::Impulse &impulse)
+{
+  return (impulse.trimDb == (float)CABINET_TAIL_TRIM_DB) ? impulse.trimmed : 0;
+}
+
+// IR samples used in place in the mapped profile file,
+// copied only once they have to be changed
+struct ImpulseData
+{
+  explicit ImpulseData(const TapfFile::Impulse &impulse)
+    : data(impulse.data), count(impulse.count) {}
+
+  ImpulseData(const ImpulseData&) = delete;
+  ImpulseData& operator=(const ImpulseData&) = delete;
+
+  // Own copy of the samples, truncated or zero padded to 'size'
+  float *resize(size_t size)
+  {
+    if (data != buffer.data())
+    {
+      buffer.assign(data, data + count);
+    }
+    buffer.resize(size, 0.0);
+    data = buffer.data();
+    count = size;
+    return buffer.data();
+  }
+
+  // Takes over new 'samples'
+  void assign(std::vector<float> &&samples)
+  {
+    buffer = std::move(samples);
+    data = buffer.data();
+    count = buffer.size();
+  }
+
+  const float *data;
+  size_t count;
+
+private:
+  std::vector<float> buffer;
 };
 
+// Worker threads of realtime convolvers finish their cycles
+// at varying times, offline renders process them in place
+// with the same output on every run. The sample rate
+// gives the deadlines of pooled cycles.
+static void start_convproc(Convproc *convproc, bool offline, float sampleRate)
+{
+  if (offline)
+  {
+    convproc->start_inline();
+  }
+  else
+  {
+    convproc->start_process(CONVPROC_SCHEDULER_PRIORITY, CONVPROC_SCHEDULER_CLASS,
+                            (uint32_t)sampleRate);
+  }
+}
+
 
 namespace Steinberg {
 namespace Vst {
@@ -95,17 +188,93 @@ namespace Vst {
                                                         Vst::SpeakerArrangement* outputs,
                                                         int32 numOuts)
   {
-    if (numIns == 1 && numOuts == 1 && inputs[0] == outputs[0])
+    // FAUST code is mono, so mono input may feed stereo output
+    if (numIns == 1 && numOuts == 1 &&
+        ((inputs[0] == outputs[0]) ||
+         ((inputs[0] == SpeakerArr::kMono) && (outputs[0] == SpeakerArr::kStereo))))
     {
       return AudioEffect::setBusArrangements (inputs, numIns, outputs, numOuts);
     }
     return kResultFalse;
   }
 
+  uint32 PLUGIN_API PlugProcessor::getLatencySamples ()
+  {
+    return latencySamples.load();
+  }
+
+  // 64-bit buffers are processed only when FAUST code is built
+  // with double precision, convolvers always work with float
+  tresult PLUGIN_API PlugProcessor::canProcessSampleSize (int32 symbolicSampleSize)
+  {
+    if (symbolicSampleSize == kSample32)
+      return kResultTrue;
+    if ((symbolicSampleSize == kSample64) && (sizeof (FAUSTFLOAT) == sizeof (Sample64)))
+      return kResultTrue;
+    return kResultFalse;
+  }
+
+  uint32 PLUGIN_API PlugProcessor::getTailSamples ()
+  {
+    return tailSamples.load();
+  }
+
+  // Tail of the whole chain: preamp IR, FAUST code and
+  // cabinet IR in series, plus the latency of both FIFOs
+  // and of the oversampler. Called when the active profile changes.
+  void PlugProcessor::updateTail()
+  {
+    int32 tail = (int32)(DSP_TAIL_TIME * sampleRate) + oversampler.latency();
+    if (profile)
+    {
+      tail += profile->preampLength + profile->cabinetLength +
+        profile->preamp_fifo.latency() + profile->fifo.latency();
+    }
+
+    silence.setTailSamples(tail);
+    tailSamples.store(tail);
+  }
+
+  // Both convolvers run through FIFOs of 'fragm' samples,
+  // in zero latency mode their IR heads are direct FIRs.
+  // Oversampling filters add their own delay. Taken from
+  // the profile in use, called when it changes.
+  void PlugProcessor::updateLatency()
+  {
+    bool zeroLatency = profile ? profile->zeroLatency : zeroLatencyMode.load();
+    latencySamples.store((zeroLatency ? 0 : 2 * fragm) + oversampler.latency());
+  }
+
+  // Tonestack bands are profile parameters too,
+  // the tonestack itself runs outside FAUST code
+  void PlugProcessor::setProfile(const st_profile_header &header)
+  {
+    ui->setProfile(header);
+
+    tonestack.setBand(kTonestackLow, header.tonestack_low_freq, header.tonestack_low_band);
+    tonestack.setBand(kTonestackMiddle, header.tonestack_middle_freq, header.tonestack_middle_band);
+    tonestack.setBand(kTonestackHigh, header.tonestack_high_freq, header.tonestack_high_band);
+  }
+
   tresult PLUGIN_API PlugProcessor::setupProcessing (Vst::ProcessSetup& setup)
   {
     sampleRate = setup.sampleRate;
+
+    // Convolvers and tubes are chosen for the mode
+    // when the component is activated
+    offlineMode.store(setup.processMode == kOffline);
+
+    bufsize = setup.maxSamplesPerBlock;
+    if (bufsize < fragm)
+    {
+      bufsize = fragm;
+    }
+    if (bufsize > maxBufsize)
+    {
+      bufsize = maxBufsize;
+    }
     setBufsize(bufsize);
+
     return AudioEffect::setupProcessing (setup);
   }
 
@@ -113,28 +282,105 @@ namespace Vst {
   {
     if (state)
     {
-      dsp = new TubeampDsp();
-      dsp->init(sampleRate);
-
-      dsp->ports.drive = mDrive * 100.0;
-      dsp->ports.low = (mBass * 2.0 - 1.0) * 10.0;
-      dsp->ports.middle = (mMiddle * 2.0 - 1.0) * 10.0;
-      dsp->ports.high = (mTreble * 2.0 - 1.0) * 10.0;
-      dsp->ports.mastergain = mVolume * 100.0;
-      dsp->ports.volume = mLevel;
-      dsp->ports.cabinet = mCabinet;
+      bool offline = offlineMode.load();
 
+      // Each tube model is a separate DSP class,
+      // so that only one of them runs per sample
+      tubeModel = selectTubeModel(offline);
+      if (tubeModel == kTubesAdaa)
+      {
+        dsp = new TubeampAdaaDsp();
+        ampDsp = new TubeampAdaaAmpDsp();
+      }
+      else if (tubeModel == kTubesFast)
+      {
+        dsp = new TubeampFastDsp();
+        ampDsp = new TubeampFastAmpDsp();
+      }
+      else
+      {
+        dsp = new TubeampDsp();
+        ampDsp = new TubeampAmpDsp();
+      }
+      preDsp = new TubeampPreDsp();
+      postDsp = new TubeampPostDsp();
+      ui = new UI();
+
+      // Oversampling settings are applied here, the controller
+      // restarts the component when they are changed. Offline
+      // renders may use the highest factor with longer filters.
+      // Zero latency mode needs the profile to be rebuilt.
+      bool offlineQuality = mOfflineQuality && offline;
+      int factor = oversamplingFactor(offlineQuality);
+
+      oversampler.setup(factor,
+                        offlineQuality ? Oversampler::kOfflineFilter : Oversampler::kRealtimeFilter,
+                        bufsize);
+      faustHigh.allocate(bufsize * oversampler.factor());
+
+      // Only the nonlinear section runs at the oversampled rate
+      preDsp->init(sampleRate);
+      dsp->init(sampleRate * oversampler.factor());
+      ampDsp->init(sampleRate * oversampler.factor());
+      postDsp->init(sampleRate);
+      preDsp->buildUserInterface(ui);
+      dsp->buildUserInterface(ui);
+      ampDsp->buildUserInterface(ui);
+      postDsp->buildUserInterface(ui);
+
+      // Bands are taken from the profile, these
+      // are the defaults of the profile format
+      tonestack.setRate(sampleRate * oversampler.factor());
+      tonestack.setBand(kTonestackLow, 100, 200);
+      tonestack.setBand(kTonestackMiddle, 700, 700);
+      tonestack.setBand(kTonestackHigh, 3000, 2000);
+      tonestack.reset();
+
+      setParameter (kDriveId, mDrive);
+      setParameter (kBassId, mBass);
+      setParameter (kMiddleId, mMiddle);
+      setParameter (kTrebleId, mTreble);
+      setParameter (kVolumeId, mVolume);
+      setParameter (kLevelId, mLevel);
+      setParameter (kCabinetId, mCabinet);
+
+      cabinetMix = mCabinet;
+      cabinetPreroll = 0;
+      dryPreroll = 0;
+
+      // Cabinet convolver has at most one output per bus channel
+      SpeakerArrangement arr;
+      getBusArrangement(kOutput, 0, arr);
+      cabinetChannels = (SpeakerArr::getChannelCount(arr) >= 2) ? 2 : 1;
+
+      zeroLatencyMode.store(mZeroLatency);
+      fullImpulses.store(offlineQuality);
+
+      // load_profile() checks the file itself
       if (profilePath != "")
       {
-        if (check_profile_file(profilePath.c_str()))
+        profile = load_profile(profilePath.c_str());
+        if (profile)
         {
-          profile = load_profile(profilePath.c_str());
-          dsp->profile = &profile->header;
+          setProfile(profile->header);
         }
       }
+
+      silence.reset();
+      updateTail();
+      updateLatency();
+
+      bypass.setup(2 * fragm + oversampler.latency());
+
+      startLoader();
     }
     else
     {
+      stopLoader();
+
+      delete pendingProfile.exchange(nullptr);
+      delete retiredProfile.exchange(nullptr);
+
       if (profile)
       {
         delete profile;
@@ -146,12 +392,34 @@ namespace Vst {
         delete dsp;
         dsp = nullptr;
       }
+      if (ampDsp)
+      {
+        delete ampDsp;
+        ampDsp = nullptr;
+      }
+      if (preDsp)
+      {
+        delete preDsp;
+        preDsp = nullptr;
+      }
+      if (postDsp)
+      {
+        delete postDsp;
+        postDsp = nullptr;
+      }
+      if (ui)
+      {
+        delete ui;
+        ui = nullptr;
+      }
     }
     return AudioEffect::setActive (state);
   }
 
   tresult PLUGIN_API PlugProcessor::process (ProcessData& data)
   {
+    automation.clear ();
+
     if (data.inputParameterChanges)
     {
       int32 numParamsChanged = data.inputParameterChanges->getParameterCount ();
@@ -167,66 +435,40 @@ namespace Vst {
           switch (paramQueue->getParameterId ())
           {
             case kDriveId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mDrive = value;
-                dsp->ports.drive = value * 100.0;
-              }
+              automation.addQueue (paramQueue, mDrive);
               break;
             case kBassId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mBass = value;
-                dsp->ports.low = (value * 2.0 - 1.0) * 10.0;
-              }
+              automation.addQueue (paramQueue, mBass);
               break;
             case kMiddleId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mMiddle = value;
-                dsp->ports.middle = (value * 2.0 - 1.0) * 10.0;
-              }
+              automation.addQueue (paramQueue, mMiddle);
               break;
             case kTrebleId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mTreble = value;
-                dsp->ports.high = (value * 2.0 - 1.0) * 10.0;
-              }
+              automation.addQueue (paramQueue, mTreble);
               break;
             case kVolumeId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mVolume = value;
-                dsp->ports.mastergain = value * 100.0;
-              }
+              automation.addQueue (paramQueue, mVolume);
               break;
             case kLevelId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mLevel = value;
-                dsp->ports.volume = value;
-              }
+              automation.addQueue (paramQueue, mLevel);
               break;
             case kCabinetId:
-              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
-                kResultTrue)
-              {
-                mCabinet = value;
-                dsp->ports.cabinet = value;
-              }
+              automation.addQueue (paramQueue, mCabinet);
               break;
             case kBypassId:
               if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
                 kResultTrue)
                 mBypass = (value > 0.5f);
               break;
+            case kZeroLatencyId:
+            case kOversamplingId:
+            case kOfflineQualityId:
+            case kFastTubesId:
+            case kAntiAliasingId:
+              if (paramQueue->getPoint (numPoints - 1, sampleOffset, value) ==
+                kResultTrue)
+                setActivationSetting (paramQueue->getParameterId (), value);
+              break;
           }
         }
       }
@@ -234,103 +476,54 @@ namespace Vst {
 
     if (data.numInputs == 0 || data.numOutputs == 0)
     {
+      applyAutomation (data.numSamples);
       return kResultOk;
     }
 
-    SpeakerArrangement arr;
-    getBusArrangement(kOutput, 0, arr);
-    int32 numChannels = SpeakerArr::getChannelCount(arr);
-
-    if ((data.numSamples > 0) && (profile))
+    if (offlineMode.load())
     {
-      float* inputs[2];
-      float* outputs[2];
+      waitLoader();
+      collectRetiredProfile();
+    }
 
-      if (numChannels >= 2)
+    // Pick up the profile prepared by the loader thread.
+    // The previous one goes back to the loader for deletion,
+    // so no new profile is taken until the retired slot is free.
+    if (pendingProfile.load(std::memory_order_acquire) &&
+        !retiredProfile.load(std::memory_order_acquire))
+    {
+      stProfile *newProfile = pendingProfile.exchange(nullptr, std::memory_order_acq_rel);
+      if (newProfile)
       {
-        inputs[0] = data.inputs[0].channelBuffers32[0];
-        inputs[1] = data.inputs[0].channelBuffers32[1];
+        retiredProfile.store(profile, std::memory_order_release);
+        profile = newProfile;
+        setProfile(profile->header);
 
-        outputs[0] = data.outputs[0].channelBuffers32[0];
-        outputs[1] = data.outputs[0].channelBuffers32[1];
-      }
-      else
-      {
-        inputs[0] = data.inputs[0].channelBuffers32[0];
-        inputs[1] = data.inputs[0].channelBuffers32[0];
+        // New convolver starts from a clean state
+        cabinetPreroll = 0;
 
-        outputs[0] = data.outputs[0].channelBuffers32[0];
-        outputs[1] = data.outputs[0].channelBuffers32[0];
+        updateTail();
+        updateLatency();
       }
+    }
 
-      if (!mBypass)
+    if ((data.numSamples > 0) && (profile))
+    {
+      if (data.symbolicSampleSize == kSample64)
       {
-        for (int i = 0; i < data.numSamples; i++)
-        {
-          preamp_inp_buf[i] = (inputs[0][i] + inputs[1][i]) / 2.0;
-        }
-
-        int bufp = 0;
-
-        while (bufp < data.numSamples)
-        {
-          memcpy(profile->preamp_convproc.inpdata(0),
-            preamp_inp_buf.data() + bufp,
-            fragm * sizeof(float));
-          profile->preamp_convproc.process(true);
-          memcpy(preamp_outp_buf.data() + bufp,
-            profile->preamp_convproc.outdata(0),
-            fragm * sizeof(float));
-          bufp += fragm;
-        }
-
-        for (int i = 0; i < data.numSamples; i++)
-        {
-          inputs[0][i] = preamp_outp_buf[i];
-          inputs[1][i] = preamp_outp_buf[i];
-        }
-
-        dsp->compute(data.numSamples, inputs, outputs);
-        bufp = 0;
-
-        memcpy(drybuf_l.data(), outputs[0], data.numSamples * sizeof(float));
-        memcpy(drybuf_r.data(), outputs[1], data.numSamples * sizeof(float));
-
-        while (bufp < data.numSamples)
-        {
-          memcpy(profile->convproc.inpdata(0), outputs[0] + bufp, fragm * sizeof(float));
-          memcpy(profile->convproc.inpdata(1), outputs[1] + bufp, fragm * sizeof(float));
-
-          profile->convproc.process(true);
-          memcpy(outputs[0] + bufp, profile->convproc.outdata(0), fragm * sizeof(float));
-          memcpy(outputs[1] + bufp, profile->convproc.outdata(1), fragm * sizeof(float));
-
-          bufp += fragm;
-        }
-
-        for (int i = 0; i < data.numSamples; i++)
-        {
-          outputs[0][i] = outputs[0][i] * (dsp->ports.cabinet) + drybuf_l[i] * (1.0 - dsp->ports.cabinet);
-          outputs[1][i] = outputs[1][i] * (dsp->ports.cabinet) + drybuf_r[i] * (1.0 - dsp->ports.cabinet);
-        }
+        processAudio (data, data.inputs[0].channelBuffers64, data.outputs[0].channelBuffers64);
       }
       else
       {
-        for (int i = 0; i < data.numSamples; i++)
-        {
-          outputs[0][i] = inputs[0][i];
-          outputs[1][i] = inputs[1][i];
-        }
+        processAudio (data, data.inputs[0].channelBuffers32, data.outputs[0].channelBuffers32);
       }
     }
     else
     {
-      for (int i = 0; i < numChannels; i++)
-      {
-        memset(data.outputs[0].channelBuffers32[i], 0, data.numSamples * sizeof(float));
-      }
+      SilenceDetector::silence(data.outputs[0], data.numSamples, data.symbolicSampleSize);
     }
 
+    applyAutomation (data.numSamples);
 
     return kResultOk;
   }
@@ -376,6 +569,27 @@ namespace Vst {
 
     profilePath = streamer.readStr8();
 
+    // Absent in states saved by older versions
+    int32 savedZeroLatency = 0;
+    if (streamer.readInt32(savedZeroLatency) == false)
+      savedZeroLatency = 0;
+
+    float savedOversampling = 0.f;
+    if (streamer.readFloat(savedOversampling) == false)
+      savedOversampling = 0.f;
+
+    int32 savedOfflineQuality = 0;
+    if (streamer.readInt32(savedOfflineQuality) == false)
+      savedOfflineQuality = 0;
+
+    int32 savedAntiAliasing = 0;
+    if (streamer.readInt32(savedAntiAliasing) == false)
+      savedAntiAliasing = 0;
+
+    int32 savedFastTubes = 0;
+    if (streamer.readInt32(savedFastTubes) == false)
+      savedFastTubes = 0;
+
     mDrive = savedDrive;
     mBass = savedBass;
     mMiddle = savedMiddle;
@@ -384,14 +598,24 @@ namespace Vst {
     mLevel = savedLevel;
     mCabinet = savedCabinet;
     mBypass = savedBypass > 0;
-
-    dsp->ports.drive = mDrive * 100.0;
-    dsp->ports.low = (mBass * 2.0 - 1.0) * 10.0;
-    dsp->ports.middle = (mMiddle * 2.0 - 1.0) * 10.0;
-    dsp->ports.high = (mTreble * 2.0 - 1.0) * 10.0;
-    dsp->ports.mastergain = mVolume * 100.0;
-    dsp->ports.volume = mLevel;
-    dsp->ports.cabinet = mCabinet;
+    mZeroLatency = savedZeroLatency > 0;
+    mOversampling = savedOversampling;
+    mOfflineQuality = savedOfflineQuality > 0;
+    mFastTubes = savedFastTubes > 0;
+    mAntiAliasing = savedAntiAliasing > 0;
+
+    setParameter (kDriveId, mDrive);
+    setParameter (kBassId, mBass);
+    setParameter (kMiddleId, mMiddle);
+    setParameter (kTrebleId, mTreble);
+    setParameter (kVolumeId, mVolume);
+    setParameter (kLevelId, mLevel);
+    setParameter (kCabinetId, mCabinet);
+
+    if (loaderThread.joinable() && (profilePath != ""))
+    {
+      requestProfile(profilePath);
+    }
 
     return kResultOk;
   }
@@ -417,14 +641,15 @@ namespace Vst {
     streamer.writeFloat (toSaveCabinet);
     streamer.writeInt32 (toSaveBypass);
 
-    if (profile)
-    {
-      streamer.writeStr8(profile->path.c_str());
-    }
-    else
-    {
-      streamer.writeStr8("");
-    }
+    // Profile itself belongs to the audio thread,
+    // store the path of the last requested one
+    streamer.writeStr8(profilePath.c_str());
+
+    streamer.writeInt32 (mZeroLatency ? 1 : 0);
+    streamer.writeFloat ((float)mOversampling);
+    streamer.writeInt32 (mOfflineQuality ? 1 : 0);
+    streamer.writeInt32 (mAntiAliasing ? 1 : 0);
+    streamer.writeInt32 (mFastTubes ? 1 : 0);
 
     return kResultOk;
   }
@@ -435,220 +660,706 @@ namespace Vst {
     {
       if (check_profile_file(text))
       {
-        stProfile *oldProfile = profile;
-        profile = load_profile(text);
         profilePath = text;
-        dsp->profile = &profile->header;
-        if (oldProfile)
+
+        // When not active the profile is loaded by setActive
+        if (loaderThread.joinable())
         {
-          delete oldProfile;
+          requestProfile(profilePath);
         }
       }
     }
     return kResultOk;
   }
 
-  bool PlugProcessor::check_profile_file(const char *path)
+  tresult PLUGIN_API PlugProcessor::notify (IMessage* message)
   {
-    bool status = false;
+    ParamID id;
+    ParamValue value;
+    if (readSetting (message, id, value))
+    {
+      setActivationSetting (id, value);
+      if (!settingsApplied ())
+      {
+        sendRestart (this);
+      }
+      return kResultOk;
+    }
+    return AudioEffect::notify (message);
+  }
 
-    FILE * profile_file = fopen(path, "rb");
+  void PlugProcessor::startLoader()
+  {
+    {
+      std::lock_guard<std::mutex> lock(loaderMutex);
+      loaderQuit = false;
+      loaderHasRequest = false;
+      loaderBusy = false;
+    }
+    loaderThread = std::thread(&PlugProcessor::loaderMain, this);
+  }
 
-    if (profile_file != NULL)
+  void PlugProcessor::stopLoader()
+  {
+    if (!loaderThread.joinable())
     {
-      st_profile_header check_profile;
-      if (fread(&check_profile, sizeof(st_profile_header), 1, profile_file) == 1)
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(loaderMutex);
+      loaderQuit = true;
+    }
+    loaderCond.notify_one();
+    loaderIdle.notify_all();
+    loaderThread.join();
+  }
+
+  void PlugProcessor::requestProfile(const std::string &path)
+  {
+    {
+      std::lock_guard<std::mutex> lock(loaderMutex);
+      loaderRequest = path;
+      loaderHasRequest = true;
+    }
+    loaderCond.notify_one();
+  }
+
+  // Loader thread main loop. Builds requested profiles
+  // and deletes profiles released by the audio thread.
+  // The audio thread never signals this thread,
+  // so retired profiles are collected by polling.
+  void PlugProcessor::loaderMain()
+  {
+    std::unique_lock<std::mutex> lock(loaderMutex);
+
+    while (!loaderQuit)
+    {
+      loaderCond.wait_for(lock, std::chrono::milliseconds(50),
+                          [this] { return loaderQuit || loaderHasRequest; });
+
+      std::string path;
+      bool hasRequest = loaderHasRequest && !loaderQuit;
+      if (hasRequest)
       {
-        if (!strncmp(check_profile.signature, "TaPf", 4))
+        path = loaderRequest;
+        loaderHasRequest = false;
+      }
+      loaderBusy = true;
+
+      lock.unlock();
+
+      if (hasRequest)
+      {
+        stProfile *newProfile = load_profile(path.c_str());
+        if (newProfile)
         {
-          status = true;
+          // Profile not yet taken by the audio thread
+          // is replaced by the newer one
+          delete pendingProfile.exchange(newProfile, std::memory_order_acq_rel);
         }
       }
-      else status = false;
 
-      fclose(profile_file);
+      collectRetiredProfile();
+
+      lock.lock();
+      loaderBusy = false;
+      loaderIdle.notify_all();
+    }
+  }
+
+  // Called on the audio thread. Blocking is fine offline,
+  // the host waits for the block anyway.
+  void PlugProcessor::waitLoader()
+  {
+    std::unique_lock<std::mutex> lock(loaderMutex);
+    loaderIdle.wait(lock, [this] {
+      return loaderQuit ||
+        (!loaderHasRequest && !loaderBusy);
+    });
+  }
+
+  void PlugProcessor::collectRetiredProfile()
+  {
+    stProfile *oldProfile = retiredProfile.exchange(nullptr, std::memory_order_acq_rel);
+    if (oldProfile)
+    {
+      delete oldProfile;
     }
+  }
 
-    return status;
+  bool PlugProcessor::check_profile_file(const char *path)
+  {
+    TapfFile file;
+    return file.open(path);
   }
 
   // Function loads profile from file at 'path'
-  // and creates new convolvers
-  // with IR data from that *.tapf file
+  // and creates new convolvers linked to
+  // the IR partitions of that *.tapf file
   stProfile* PlugProcessor::load_profile(const char *path)
   {
+    // Mapping is released on every return
+    TapfFile file;
+    if (!file.open(path))
+    {
+      return nullptr;
+    }
+
+    // In zero latency mode first 'fragm' taps of both IRs
+    // are direct FIRs, convolvers get the rest
+    bool zeroLatency = zeroLatencyMode.load();
+    unsigned int head = zeroLatency ? fragm : 0;
+
+    // Version 2 profiles store their hash, so a cached
+    // profile is found without reading all of the file
+    ProfileCache::Key key;
+    key.hash = file.contentHash() ? file.contentHash() :
+      ProfileCache::hash(file.data(), file.size());
+    key.size = file.size();
+    key.sampleRate = sampleRate;
+    key.quantum = fragm;
+    key.head = head;
+    key.cabinetChannels = cabinetChannels;
+    key.fullImpulses = fullImpulses.load();
+
+    // Other instances with the same profile have
+    // already prepared it, or an earlier session did
+    std::shared_ptr<const ProfileImpulses> impulses = ProfileCache::find(key);
+    if (!impulses)
+    {
+      impulses = ProfileCache::load(key);
+      if (!impulses)
+      {
+        if (!file.verify())
+        {
+          return nullptr;
+        }
+        impulses = prepare_impulses(file, head, key.fullImpulses);
+        if (!impulses)
+        {
+          return nullptr;
+        }
+        ProfileCache::store(key, *impulses);
+      }
+      impulses = ProfileCache::insert(key, impulses);
+    }
+
+    bool offline = offlineMode.load();
+
+    stProfile *p_profile = new stProfile();
+    p_profile->path = path;
+    p_profile->impulses = impulses;
+    p_profile->header = impulses->header;
+    p_profile->cabinetOutputs = impulses->cabinetOutputs;
+    p_profile->cabinetLength = impulses->cabinetLength;
+    p_profile->zeroLatency = zeroLatency;
+    p_profile->preampLength = impulses->preampLength;
+
+    // Create preamp convolver
+    Convproc *p_preamp_convproc = &p_profile->preamp_convproc;
+    p_preamp_convproc->configure (1, 1, impulses->preampSize,
+                                  fragm, fragm, Convproc::MAXPART, 0.0);
+    p_preamp_convproc->impdata_link (&impulses->preamp, 0, 0, 0, 0);
+
+    start_convproc(p_preamp_convproc, offline, sampleRate);
+    p_profile->preamp_fifo.setup(p_preamp_convproc, 1, 1, fragm, THREAD_SYNC_MODE);
+    if (zeroLatency)
+    {
+      p_profile->preamp_fifo.setHead(0, impulses->preampHead.data());
+    }
+
+    // Create cabsym convolver. Its input is the mono amp output,
+    // different left and right IRs give two outputs.
+    Convproc *p_convproc = &p_profile->convproc;
+    p_convproc->configure (1, impulses->cabinetOutputs, impulses->cabinetSize,
+                           fragm, fragm, Convproc::MAXPART, 0.0);
+    for (int out = 0; out < impulses->cabinetOutputs; out++)
+    {
+      p_convproc->impdata_link (&impulses->cabinet, 0, out, 0, out);
+    }
+
+    start_convproc(p_convproc, offline, sampleRate);
+    p_profile->fifo.setup(p_convproc, 1, impulses->cabinetOutputs, fragm, THREAD_SYNC_MODE);
+    if (zeroLatency)
+    {
+      for (int out = 0; out < impulses->cabinetOutputs; out++)
+      {
+        p_profile->fifo.setHead(out, impulses->cabinetHead[out].data());
+      }
+    }
+
+    return p_profile;
+  }
+
+  // Takes the IRs of 'file' rendered at the current rate or
+  // resamples them and fills the IR partitions.
+  // 'head' taps are left to the direct FIRs.
+  std::shared_ptr<const ProfileImpulses> PlugProcessor::prepare_impulses(
+    const TapfFile &file, unsigned int head, bool fullLength)
+  {
+    std::shared_ptr<ProfileImpulses> impulses = std::make_shared<ProfileImpulses>();
+    impulses->header = file.header();
+
+    // IRs in *.tapf are 48000 Hz,
+    // calculate ratio for resampling
+    float ratio = (float)sampleRate / 48000.0;
+
+    // Version 2 profiles may carry the IRs
+    // already rendered at the current rate
+    TapfFile::Impulse preamp, cabinet[2];
+    bool rendered = file.rendered(sampleRate, preamp, cabinet);
+    if (!rendered)
+    {
+      preamp = file.preamp();
+      cabinet[0] = file.cabinet(0);
+      cabinet[1] = file.cabinet(1);
+    }
 
-    FILE *profile_file = fopen(path, "rb");
-    if (profile_file != NULL)
+    ImpulseData preamp_impulse(preamp);
+    ImpulseData left_impulse(cabinet[0]);
+    ImpulseData right_impulse(cabinet[1]);
+
+    // Shorter IR is padded, so both have the same length
+    size_t cabinet_count = std::max(left_impulse.count, right_impulse.count);
+    if (left_impulse.count < cabinet_count)
+    {
+      left_impulse.resize(cabinet_count);
+    }
+    if (right_impulse.count < cabinet_count)
     {
-      stProfile *p_profile = new stProfile();
+      right_impulse.resize(cabinet_count);
+    }
+
+    // Identical left and right IRs need only one convolver channel,
+    // its output is copied to the right channel
+    bool cabinetMono = (left_impulse.data == right_impulse.data) ||
+      !memcmp(left_impulse.data, right_impulse.data, cabinet_count * sizeof(float));
+    int cabinetIRs = cabinetMono ? 1 : 2;
 
-      if (fread(&p_profile->header, sizeof(st_profile_header), 1, profile_file) == 1)
+    // Otherwise, if current rate is not 48000 Hz
+    // do resampling with Zita-resampler
+    if (!rendered && (sampleRate != 48000))
+    {
       {
+        std::vector<float> resampled(TapfFile::resampledCount(preamp_impulse.count, sampleRate));
+        float *out = resampled.data();
+        TapfFile::resample(&preamp_impulse.data, 1, preamp_impulse.count, sampleRate, &out);
+        preamp_impulse.assign(std::move(resampled));
+      }
 
-        // IRs in *.tapf are 48000 Hz,
-        // calculate ratio for resampling
-        float ratio = (float)sampleRate / 48000.0;
+      {
+        size_t count = TapfFile::resampledCount(cabinet_count, sampleRate);
+        std::vector<float> left(count);
+        std::vector<float> right(cabinetMono ? 0 : count);
 
-        st_impulse_header preamp_impheader, impheader;
+        const float *inp[2] = {left_impulse.data, right_impulse.data};
+        float *out[2] = {left.data(), right.data()};
+        TapfFile::resample(inp, cabinetIRs, cabinet_count, sampleRate, out);
 
-        // Load preamp IR data to temp buffer
-        if (fread(&preamp_impheader, sizeof(st_impulse_header), 1, profile_file) != 1)
+        if (cabinetMono)
         {
-          return NULL;
+          right = left;
         }
-        std::vector<float> preamp_impulse(preamp_impheader.sample_count);
-        if (fread(preamp_impulse.data(), sizeof(float),
-          preamp_impheader.sample_count,
-          profile_file) != (size_t)preamp_impheader.sample_count)
+        left_impulse.assign(std::move(left));
+        right_impulse.assign(std::move(right));
+      }
+    }
+
+    // Preamp IR partitions
+    impulses->preampLength = preamp_impulse.count;
+    if (preamp_impulse.count < head + 1)
+    {
+      preamp_impulse.resize(head + 1);
+    }
+    impulses->preampSize = preamp_impulse.count - head;
+    impulses->preampHead.assign(preamp_impulse.data, preamp_impulse.data + head);
+
+    Convproc *p_preamp_convproc = &impulses->preamp;
+    p_preamp_convproc->configure (1, 1, impulses->preampSize,
+                                  fragm, fragm, Convproc::MAXPART, 0.0);
+    p_preamp_convproc->impdata_create (0, 0, 1, preamp_impulse.data + head,
+                                       0, impulses->preampSize);
+
+    // Cabinet IR partitions. For mono bus
+    // different left and right IRs are mixed into one.
+    bool mixed = (cabinetChannels == 1) && !cabinetMono;
+    if (mixed)
+    {
+      float *left = left_impulse.resize(left_impulse.count);
+      for (size_t i = 0; i < left_impulse.count; i++)
+      {
+        left[i] = (left[i] + right_impulse.data[i]) / 2.0;
+      }
+      cabinetMono = true;
+    }
+    impulses->cabinetOutputs = cabinetMono ? 1 : 2;
+
+    // Convolver length follows the (resampled) IR,
+    // optionally without its inaudible tail.
+    // Rendered IRs may come with their trimmed lengths.
+    unsigned int cabinet_length = left_impulse.count;
+    if (CABINET_TAIL_TRIM && !fullLength)
+    {
+      size_t left_trim = (rendered && !mixed) ? stored_trim(cabinet[0]) : 0;
+      cabinet_length = left_trim ? left_trim :
+        TapfFile::trimmedLength(left_impulse.data, left_impulse.count, CABINET_TAIL_TRIM_DB);
+      if (!cabinetMono)
+      {
+        size_t right_trim = rendered ? stored_trim(cabinet[1]) : 0;
+        cabinet_length = std::max((size_t)cabinet_length, right_trim ? right_trim :
+          TapfFile::trimmedLength(right_impulse.data, right_impulse.count, CABINET_TAIL_TRIM_DB));
+      }
+    }
+
+    impulses->cabinetLength = cabinet_length;
+
+    cabinet_length = std::max(cabinet_length, head + 1);
+    if (left_impulse.count < cabinet_length)
+    {
+      left_impulse.resize(cabinet_length);
+      right_impulse.resize(cabinet_length);
+    }
+    impulses->cabinetSize = cabinet_length - head;
+
+    Convproc *p_convproc = &impulses->cabinet;
+    p_convproc->configure (1, impulses->cabinetOutputs, impulses->cabinetSize,
+                           fragm, fragm, Convproc::MAXPART, 0.0);
+
+    p_convproc->impdata_create (0, 0, 1, left_impulse.data + head,
+                                0, impulses->cabinetSize);
+    impulses->cabinetHead[0].assign(left_impulse.data, left_impulse.data + head);
+    if (!cabinetMono)
+    {
+      p_convproc->impdata_create (0, 1, 1, right_impulse.data + head,
+                                  0, impulses->cabinetSize);
+      impulses->cabinetHead[1].assign(right_impulse.data, right_impulse.data + head);
+    }
+
+    return impulses;
+  }
+
+  template <typename SampleType>
+  void PlugProcessor::processAudio (ProcessData& data, SampleType **in, SampleType **out)
+  {
+    if (!mBypass && silence.update(data.inputs[0], data.numSamples, data.symbolicSampleSize))
+    {
+      // Input has been silent longer than the tail,
+      // convolver states hold only silence and are left
+      // as they are. They continue seamlessly on wake.
+      SilenceDetector::silence(data.outputs[0], data.numSamples, data.symbolicSampleSize);
+    }
+    else if (!mBypass)
+    {
+      data.outputs[0].silenceFlags = 0;
+
+      // Blocks longer than the scratch buffers
+      // are processed in several parts
+      int32 blockStart = 0;
+      while (blockStart < data.numSamples)
+      {
+        int32 blockEnd = blockStart + bufsize;
+        if (blockEnd > data.numSamples)
         {
-          return NULL;
+          blockEnd = data.numSamples;
         }
 
-        std::vector<float> left_impulse;
-        std::vector<float> right_impulse;
-        // Load cabsym IR data to temp buffers
-        for (int i=0;i<2;i++)
-        {
-          if (fread(&impheader, sizeof(st_impulse_header), 1, profile_file) != 1)
-          {
-            return NULL;
-          }
+        processBlock (in, data.inputs[0].numChannels, out, blockStart, blockEnd);
+        blockStart = blockEnd;
+      }
+    }
+    else
+    {
+      silence.reset();
+      data.outputs[0].silenceFlags = data.inputs[0].silenceFlags;
 
-          if (impheader.channel==0)
-          {
-            left_impulse.resize(impheader.sample_count);
-            if (fread(left_impulse.data(), sizeof(float),
-              impheader.sample_count, profile_file) != (size_t)impheader.sample_count)
-            {
-              return NULL;
-            }
-          }
-          if (impheader.channel==1)
-          {
-            right_impulse.resize(impheader.sample_count);
-            if (fread(right_impulse.data(), sizeof(float),
-              impheader.sample_count, profile_file) != (size_t)impheader.sample_count)
-            {
-              return NULL;
-            }
-          }
-        }
+      bypass.process (in, data.inputs[0].numChannels,
+                      out, data.outputs[0].numChannels, data.numSamples,
+                      profile->preamp_fifo.latency() + profile->fifo.latency() +
+                      oversampler.latency());
+    }
+  }
 
-        // If current rate is not 48000 Hz do resampling
-        // with Zita-resampler
-        if (sampleRate!=48000)
-        {
-          {
-            Resampler resampl;
-            resampl.setup(48000,sampleRate,1,48);
+  // Allocates all per-block scratch buffers as one
+  // cache line aligned chunk. Called outside of the audio thread.
+  void PlugProcessor::setBufsize(int size)
+  {
+    size_t stride = AlignedBuffer<float>::roundUp(size);
 
-            int k = resampl.inpsize();
+    scratch.allocate(stride * 4);
 
-            std::vector<float> preamp_in(preamp_impheader.sample_count + k/2 - 1 + k - 1);
-            std::vector<float> preamp_out((unsigned int)((preamp_impheader.sample_count + k/2 - 1 + k - 1)*ratio));
+    preamp_inp_buf = scratch.data();
+    preamp_outp_buf = preamp_inp_buf + stride;
+    cabinet_buf[0] = preamp_outp_buf + stride;
+    cabinet_buf[1] = cabinet_buf[0] + stride;
 
-            // Create paddig before and after signal, needed for zita-resampler
-            for (int i = 0; i < preamp_impheader.sample_count + k/2 - 1 + k - 1; i++)
-            {
-              preamp_in[i] = 0.0;
-            }
+    faustScratch.allocate(stride * 3);
 
-            for (int i = k/2 - 1; i < preamp_impheader.sample_count + k/2 - 1; i++)
-            {
-              preamp_in[i] = preamp_impulse[i - k/2 + 1];
-            }
+    faust_inp_buf = faustScratch.data();
+    faust_outp_buf = faust_inp_buf + stride;
+    drybuf = faust_outp_buf + stride;
+  }
 
-            resampl.inp_count = preamp_impheader.sample_count + k/2 - 1 + k - 1;
-            resampl.out_count = (unsigned int)((preamp_impheader.sample_count + k/2 - 1 + k - 1)*ratio);
-            resampl.inp_data = preamp_in.data();
-            resampl.out_data = preamp_out.data();
+  // Processes samples [start, end) of the host buffers,
+  // end - start must not exceed bufsize.
+  // Preamp and FAUST code are mono, stereo input is mixed down
+  // and the cabinet convolver gives up to one output per bus channel.
+  template <typename SampleType>
+  void PlugProcessor::processBlock (SampleType **inputs, int32 numInputs, SampleType **outputs,
+                                    int32 start, int32 end)
+  {
+    int32 numSamples = end - start;
 
-            resampl.process();
+    // Convolvers work with float samples, host samples
+    // are converted at their inputs and outputs
+    float *preamp_inp;
+    if (numInputs >= 2)
+    {
+      for (int i = 0; i < numSamples; i++)
+      {
+        preamp_inp_buf[i] = (inputs[0][start + i] + inputs[1][start + i]) / 2.0;
+      }
+      preamp_inp = preamp_inp_buf;
+    }
+    else
+    {
+      preamp_inp = convertSamples (inputs[0] + start, preamp_inp_buf, numSamples);
+    }
 
-            preamp_impulse.resize(preamp_impheader.sample_count * ratio);
-            for (unsigned int i = 0; i < (unsigned int)(preamp_impheader.sample_count*ratio); i++)
-            {
-              preamp_impulse[i] = preamp_out[i] / ratio;
-            }
-          }
+    profile->preamp_fifo.process(&preamp_inp, &preamp_outp_buf, numSamples);
 
-          {
-            Resampler resampl;
-            resampl.setup(48000,sampleRate,2,48);
+    // FAUST output goes to the first host channel
+    // when precisions are the same
+    FAUSTFLOAT *ampOutput = outputSamples (outputs[0] + start, faust_outp_buf);
 
-            int k = resampl.inpsize();
+    // Render in sub-blocks split at automation points
+    int32 pos = start;
+    while (pos < end)
+    {
+      int32 subEnd = automation.nextSplit (pos, end);
+      applyAutomation (subEnd);
 
-            std::vector<float> inp_data((impheader.sample_count + k/2 - 1 + k - 1)*2);
+      FAUSTFLOAT* subInput = convertSamples (preamp_outp_buf + (pos - start),
+                                             faust_inp_buf + (pos - start), subEnd - pos);
+      FAUSTFLOAT* subOutput = ampOutput + (pos - start);
+      preDsp->compute (subEnd - pos, &subInput, &subOutput);
 
-            // Create paddig before and after signal, needed for zita-resampler
-            for (int i = 0; i < impheader.sample_count + k/2 - 1 + k - 1; i++)
-            {
-              inp_data[i*2] = 0.0;
-              inp_data[i*2+1] = 0.0;
-            }
+      if (oversampler.factor() > 1)
+      {
+        oversampler.process (subOutput, subOutput, subEnd - pos, [this] (float *high, int count) {
+          FAUSTFLOAT* highData = convertSamples (high, faustHigh.data(), count);
+          dsp->compute (count, &highData, &highData);
+          tonestack.process (highData, count);
+          ampDsp->compute (count, &highData, &highData);
+          storeSamples (highData, high, count);
+        });
+      }
+      else
+      {
+        dsp->compute (subEnd - pos, &subOutput, &subOutput);
+        tonestack.process (subOutput, subEnd - pos);
+        ampDsp->compute (subEnd - pos, &subOutput, &subOutput);
+      }
 
-            for (int i = k/2 - 1; i < impheader.sample_count + k/2 - 1; i++)
-            {
-              inp_data[i*2] = left_impulse[i-k/2+1];
-              inp_data[i*2+1] = right_impulse[i-k/2+1];
-            }
+      postDsp->compute (subEnd - pos, &subOutput, &subOutput);
 
-            std::vector<float> out_data((unsigned int)((impheader.sample_count + k/2 - 1 + k - 1)*ratio*2));
+      pos = subEnd;
+    }
 
-            resampl.inp_count = impheader.sample_count + k/2 - 1 + k - 1;
-            resampl.out_count = (unsigned int)((impheader.sample_count + k/2 - 1 + k - 1)*ratio);
-            resampl.inp_data = inp_data.data();
-            resampl.out_data = out_data.data();
+    // The dry signal keeps FAUST precision up to the host buffers,
+    // only the cabinet convolver input is converted to float
+    SampleType *host[2] = {outputs[0] + start, outputs[cabinetChannels - 1] + start};
+    float *out[2] = {outputSamples (host[0], cabinet_buf[0]),
+                     outputSamples (host[1], cabinet_buf[1])};
 
-            resampl.process();
+    // Cabinet mix is ramped over the whole block from the
+    // last applied value to the parameter value at its end.
+    // While a pre-roll is running the mix is held at an endpoint.
+    float cabinetStart = cabinetMix;
+    float cabinetEnd = mCabinet;
 
-            left_impulse.resize((unsigned int)(impheader.sample_count * ratio));
-            right_impulse.resize((unsigned int)(impheader.sample_count * ratio));
+    // At the endpoints only one of the paths is audible
+    bool runDry = !((cabinetStart >= 1.0) && (cabinetEnd >= 1.0));
+    bool runConvolver = !((cabinetStart <= 0.0) && (cabinetEnd <= 0.0));
 
-            for (unsigned int i = 0; i < (unsigned int)(impheader.sample_count*ratio); i++)
-            {
-              left_impulse[i] = out_data[i*2] / ratio;
-              right_impulse[i] = out_data[i*2+1] / ratio;
-            }
-          }
+    if (cabinetPreroll > 0)
+    {
+      cabinetEnd = 0.0;
+    }
+    if (dryPreroll > 0)
+    {
+      cabinetEnd = 1.0;
+    }
 
-        }
+    if (!runConvolver)
+    {
+      // Convolver is parked, output is the delayed dry signal.
+      // When it is woken up, its output stays muted until
+      // the stale state is flushed by the new input.
+      profile->fifo.bypass(&ampOutput, numSamples);
+      cabinetPreroll = profile->cabinetLength + profile->fifo.latency();
+    }
+    else if (!runDry)
+    {
+      // Dry delay line is not fed, so it is refilled
+      // before the mix can leave 1.0
+      storeSamples (ampOutput, out[0], numSamples);
+      profile->fifo.process(out, out, numSamples);
+      dryPreroll = profile->fifo.latency();
+    }
+    else
+    {
+      memcpy(drybuf, ampOutput, numSamples * sizeof(FAUSTFLOAT));
+      storeSamples (ampOutput, out[0], numSamples);
 
-        // Create preamp convolver
-        Convproc *p_preamp_convproc = &p_profile->preamp_convproc;
-        p_preamp_convproc->configure (1, 1, (unsigned int)(preamp_impheader.sample_count*ratio),
-                                      fragm, fragm, Convproc::MAXPART, 0.0);
-        p_preamp_convproc->impdata_create (0, 0, 1, preamp_impulse.data(),
-                                           0, (unsigned int)(preamp_impheader.sample_count*ratio));
+      // Dry signal is delayed by the FIFO together
+      // with the cabinet convolver output
+      profile->fifo.process(out, out, &drybuf, numSamples);
 
-        p_preamp_convproc->start_process(CONVPROC_SCHEDULER_PRIORITY,
-                                         CONVPROC_SCHEDULER_CLASS);
+      float cabinetStep = (cabinetEnd - cabinetStart) / numSamples;
 
-        // Create cabsym convolver
-        Convproc *p_convproc = &p_profile->convproc;
-        p_convproc->configure (2, 2, 48000/2, fragm, fragm, Convproc::MAXPART, 0.0);
+      for (int c = 0; c < profile->cabinetOutputs; c++)
+      {
+        for (int i = 0; i < numSamples; i++)
+        {
+          SampleType cabinet = cabinetStart + cabinetStep * (i + 1);
+          host[c][i] = out[c][i] * cabinet + drybuf[i] * (1.0 - cabinet);
+        }
+      }
 
-        p_convproc->impdata_create (0, 0, 1, left_impulse.data(), 0, 48000/2);
-        p_convproc->impdata_create (1, 1, 1, right_impulse.data(), 0, 48000/2);
+      cabinetPreroll = std::max(cabinetPreroll - numSamples, 0);
+      dryPreroll = std::max(dryPreroll - numSamples, 0);
+    }
 
-        p_convproc->start_process (CONVPROC_SCHEDULER_PRIORITY, CONVPROC_SCHEDULER_CLASS);
+    cabinetMix = cabinetEnd;
 
-        fclose(profile_file);
+    int numResults = runConvolver ? profile->cabinetOutputs : 1;
 
-        p_profile->path = path;
-        return p_profile;
+    // Outputs of the endpoint paths are not mixed
+    // and still have to be stored to the host buffers
+    if (!runConvolver)
+    {
+      storeSamples (ampOutput, host[0], numSamples);
+    }
+    else if (!runDry)
+    {
+      for (int c = 0; c < numResults; c++)
+      {
+        storeSamples (out[c], host[c], numSamples);
       }
     }
-    return nullptr;
+
+    // Mono cabinet output or dry signal
+    // is duplicated to the right channel
+    if ((cabinetChannels == 2) && (numResults == 1))
+    {
+      memcpy(host[1], host[0], numSamples * sizeof(SampleType));
+    }
   }
 
-  void PlugProcessor::setBufsize(int size)
+
+  void PlugProcessor::setActivationSetting (ParamID id, ParamValue value)
+  {
+    switch (id)
+    {
+      case kZeroLatencyId:
+        mZeroLatency = (value > 0.5f);
+        break;
+      case kOversamplingId:
+        mOversampling = value;
+        break;
+      case kOfflineQualityId:
+        mOfflineQuality = (value > 0.5f);
+        break;
+      case kFastTubesId:
+        mFastTubes = (value > 0.5f);
+        break;
+      case kAntiAliasingId:
+        mAntiAliasing = (value > 0.5f);
+        break;
+    }
+  }
+
+  // True when setActive() would build the same chain
+  // as the one in use with the current settings
+  bool PlugProcessor::settingsApplied ()
+  {
+    bool offline = offlineMode.load();
+    bool offlineQuality = mOfflineQuality && offline;
+
+    return (zeroLatencyMode.load() == mZeroLatency) &&
+      (fullImpulses.load() == offlineQuality) &&
+      (oversampler.factor() == oversamplingFactor(offlineQuality)) &&
+      (tubeModel == selectTubeModel(offline));
+  }
+
+  // Anti-aliased tubes take precedence over the fast ones,
+  // offline renders never use the table based tubes
+  PlugProcessor::TubeModel PlugProcessor::selectTubeModel (bool offline)
+  {
+    if (mAntiAliasing)
+    {
+      return kTubesAdaa;
+    }
+    return (mFastTubes && !offline) ? kTubesFast : kTubesExact;
+  }
+
+  // Offline renders may use the highest factor
+  int PlugProcessor::oversamplingFactor (bool offlineQuality)
+  {
+    return offlineQuality ? (int)Oversampler::kMaxFactor :
+      (1 << (int)(mOversampling * 3.0 + 0.5));
+  }
+
+  // Sets normalized parameter value and updates linked FAUST control
+  void PlugProcessor::setParameter (ParamID id, ParamValue value)
+  {
+    switch (id)
+    {
+      case kDriveId:
+        mDrive = value;
+        if (ui)
+        {
+          ui->setDriveValue(value * 100.0);
+        }
+        break;
+      case kBassId:
+        mBass = value;
+        tonestack.setGain(kTonestackLow, (value * 2.0 - 1.0) * 10.0);
+        break;
+      case kMiddleId:
+        mMiddle = value;
+        tonestack.setGain(kTonestackMiddle, (value * 2.0 - 1.0) * 10.0);
+        break;
+      case kTrebleId:
+        mTreble = value;
+        tonestack.setGain(kTonestackHigh, (value * 2.0 - 1.0) * 10.0);
+        break;
+      case kVolumeId:
+        mVolume = value;
+        if (ui)
+        {
+          ui->setMastergainValue(value * 100.0);
+        }
+        break;
+      case kLevelId:
+        mLevel = value;
+        if (ui)
+        {
+          ui->setVolumeValue(value);
+        }
+        break;
+      case kCabinetId:
+        mCabinet = value;
+        break;
+    }
+  }
+
+  void PlugProcessor::applyAutomation (int32 offset)
   {
-    drybuf_l.resize(size);
-    drybuf_r.resize(size);
-    preamp_inp_buf.resize(size);
-    preamp_outp_buf.resize(size);
+    automation.apply (offset, [this] (ParamID id, ParamValue value) {
+      setParameter (id, value);
+    });
   }
 
 } // Vst
@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#include "../include/profilecache.h"
+#include "../include/mappedfile.h"
+#include "../include/tapffile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <tuple>
+
+// Header of a cache file. It is followed by the zero latency
+// heads, 'head' floats per IR, and the IR partitions,
+// 'preampParts' complex values for the preamp and
+// 'cabinetParts' for each cabinet output.
+struct stCacheHeader
+{
+  char signature[4];
+  uint32_t version;
+  uint32_t complexSize;
+  uint32_t preampParts;
+  uint32_t cabinetParts;
+
+  // Key
+  uint64_t hash;
+  uint64_t size;
+  float sampleRate;
+  int32_t quantum;
+  int32_t head;
+  int32_t cabinetChannels;
+  int32_t fullImpulses;
+
+  int32_t preampSize;
+  int32_t cabinetSize;
+  int32_t cabinetOutputs;
+  int32_t preampLength;
+  int32_t cabinetLength;
+
+  st_profile_header profile;
+};
+
+static const char cacheSignature[4] = {'K', 'P', 'P', 'S'};
+// Must be increased whenever the stored data would come out
+// differently for the same key: file layout, impulse resampling
+// or the cabinet tail trimming (CABINET_TAIL_TRIM_DB).
+static const uint32_t cacheVersion = 2;
+
+// Eviction limits. Files are used once per profile load,
+// the modification time is updated then.
+static const uint64_t cacheSizeLimit = 256ull << 20;
+static const time_t cacheMaxAge = 60 * 24 * 3600;
+// Temporary files of a crashed store
+static const time_t cacheTempAge = 3600;
+
+std::mutex ProfileCache::mutex;
+std::map<ProfileCache::Key, std::weak_ptr<const ProfileImpulses>> ProfileCache::entries;
+
+bool ProfileCache::Key::operator<(const Key &other) const
+{
+  return std::tie(hash, size, sampleRate, quantum, head, cabinetChannels, fullImpulses) <
+    std::tie(other.hash, other.size, other.sampleRate, other.quantum, other.head,
+             other.cabinetChannels, other.fullImpulses);
+}
+
+uint64_t ProfileCache::hash(const void *data, size_t size)
+{
+  return TapfFile::hash(data, size);
+}
+
+std::shared_ptr<const ProfileImpulses> ProfileCache::find(const Key &key)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto it = entries.find(key);
+  if (it == entries.end())
+  {
+    return nullptr;
+  }
+  return it->second.lock();
+}
+
+std::shared_ptr<const ProfileImpulses> ProfileCache::insert(const Key &key,
+  std::shared_ptr<const ProfileImpulses> impulses)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Entries of released profiles are dropped here
+  for (auto it = entries.begin(); it != entries.end();)
+  {
+    if (it->second.expired())
+    {
+      it = entries.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  std::weak_ptr<const ProfileImpulses> &entry = entries[key];
+  std::shared_ptr<const ProfileImpulses> cached = entry.lock();
+  if (cached)
+  {
+    return cached;
+  }
+
+  entry = impulses;
+  return impulses;
+}
+
+// Creates the directory when 'create' is set,
+// returns an empty string when there is none
+std::string ProfileCache::cacheDir(bool create)
+{
+  std::string dir;
+
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  if (xdg && (xdg[0] == '/'))
+  {
+    dir = xdg;
+  }
+  else if (home && (home[0] == '/'))
+  {
+    dir = std::string(home) + "/.cache";
+  }
+  else
+  {
+    return std::string();
+  }
+
+  if (create)
+  {
+    if ((mkdir(dir.c_str(), 0700) != 0) && (errno != EEXIST))
+    {
+      return std::string();
+    }
+  }
+  dir += "/kpp";
+  if (create)
+  {
+    if ((mkdir(dir.c_str(), 0700) != 0) && (errno != EEXIST))
+    {
+      return std::string();
+    }
+  }
+
+  return dir;
+}
+
+std::string ProfileCache::cachePath(const Key &key, bool create)
+{
+  std::string dir = cacheDir(create);
+  if (dir.empty())
+  {
+    return std::string();
+  }
+
+  char name[128];
+  snprintf(name, sizeof(name), "/%016llx-%d-%d-%d-%d-%d.spectra",
+           (unsigned long long)key.hash, (int)key.sampleRate, key.quantum,
+           key.head, key.cabinetChannels, key.fullImpulses ? 1 : 0);
+
+  return dir + name;
+}
+
+std::shared_ptr<const ProfileImpulses> ProfileCache::load(const Key &key)
+{
+  std::string path = cachePath(key, false);
+  if (path.empty())
+  {
+    return nullptr;
+  }
+
+  MappedFile file;
+  if (!file.open(path.c_str()) || (file.size() < sizeof(stCacheHeader)))
+  {
+    return nullptr;
+  }
+
+  stCacheHeader header;
+  memcpy(&header, file.data(), sizeof(header));
+
+  if (memcmp(header.signature, cacheSignature, 4) ||
+      (header.version != cacheVersion) ||
+      (header.complexSize != sizeof(fftwf_complex)) ||
+      (header.hash != key.hash) ||
+      (header.size != key.size) ||
+      (header.sampleRate != key.sampleRate) ||
+      (header.quantum != key.quantum) ||
+      (header.head != key.head) ||
+      (header.cabinetChannels != key.cabinetChannels) ||
+      ((header.fullImpulses != 0) != key.fullImpulses) ||
+      (header.cabinetOutputs < 1) || (header.cabinetOutputs > 2) ||
+      (header.preampSize < 1) || (header.cabinetSize < 1))
+  {
+    // Another version or a damaged file, it would be
+    // rejected again on every load
+    unlink(path.c_str());
+    return nullptr;
+  }
+
+  size_t heads = (size_t)header.head * (1 + header.cabinetOutputs);
+  size_t parts = header.preampParts + (size_t)header.cabinetParts * header.cabinetOutputs;
+  if (file.size() != sizeof(stCacheHeader) + heads * sizeof(float) +
+                     parts * sizeof(fftwf_complex))
+  {
+    unlink(path.c_str());
+    return nullptr;
+  }
+
+  std::shared_ptr<ProfileImpulses> impulses = std::make_shared<ProfileImpulses>();
+  impulses->header = header.profile;
+  impulses->preampSize = header.preampSize;
+  impulses->cabinetSize = header.cabinetSize;
+  impulses->cabinetOutputs = header.cabinetOutputs;
+  impulses->preampLength = header.preampLength;
+  impulses->cabinetLength = header.cabinetLength;
+
+  // Same plan as the convolvers that link to them
+  if (impulses->preamp.configure(1, 1, header.preampSize, header.quantum,
+                                 header.quantum, Convproc::MAXPART, 0.0) ||
+      impulses->cabinet.configure(1, header.cabinetOutputs, header.cabinetSize,
+                                  header.quantum, header.quantum, Convproc::MAXPART, 0.0) ||
+      (impulses->preamp.partdata_size() != header.preampParts) ||
+      (impulses->cabinet.partdata_size() != header.cabinetParts))
+  {
+    return nullptr;
+  }
+
+  const char *pos = file.data() + sizeof(stCacheHeader);
+
+  const float *head = (const float *)pos;
+  impulses->preampHead.assign(head, head + header.head);
+  for (int out = 0; out < header.cabinetOutputs; out++)
+  {
+    head += header.head;
+    impulses->cabinetHead[out].assign(head, head + header.head);
+  }
+  pos += heads * sizeof(float);
+
+  const fftwf_complex *part = (const fftwf_complex *)pos;
+  if (impulses->preamp.partdata_set(0, 0, part))
+  {
+    return nullptr;
+  }
+  part += header.preampParts;
+  for (int out = 0; out < header.cabinetOutputs; out++)
+  {
+    if (impulses->cabinet.partdata_set(0, out, part))
+    {
+      return nullptr;
+    }
+    part += header.cabinetParts;
+  }
+
+  // Marks the file as recently used for evict(),
+  // access times are not updated on every system
+  utimes(path.c_str(), nullptr);
+
+  return impulses;
+}
+
+void ProfileCache::store(const Key &key, const ProfileImpulses &impulses)
+{
+  std::string path = cachePath(key, true);
+  if (path.empty())
+  {
+    return;
+  }
+
+  stCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.signature, cacheSignature, 4);
+  header.version = cacheVersion;
+  header.complexSize = sizeof(fftwf_complex);
+  header.preampParts = impulses.preamp.partdata_size();
+  header.cabinetParts = impulses.cabinet.partdata_size();
+  header.hash = key.hash;
+  header.size = key.size;
+  header.sampleRate = key.sampleRate;
+  header.quantum = key.quantum;
+  header.head = key.head;
+  header.cabinetChannels = key.cabinetChannels;
+  header.fullImpulses = key.fullImpulses ? 1 : 0;
+  header.preampSize = impulses.preampSize;
+  header.cabinetSize = impulses.cabinetSize;
+  header.cabinetOutputs = impulses.cabinetOutputs;
+  header.preampLength = impulses.preampLength;
+  header.cabinetLength = impulses.cabinetLength;
+  header.profile = impulses.header;
+
+  // Other instances may read or write the same file,
+  // it is replaced only when complete. The temporary
+  // file gets a unique name, instances of the same
+  // process may store the same key concurrently.
+  std::string temp = path + ".XXXXXX";
+
+  int fd = mkstemp(&temp[0]);
+  if (fd < 0)
+  {
+    return;
+  }
+
+  FILE *file = fdopen(fd, "wb");
+  if (!file)
+  {
+    close(fd);
+    unlink(temp.c_str());
+    return;
+  }
+
+  bool status = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+  status = status && (fwrite(impulses.preampHead.data(), sizeof(float), key.head, file) == (size_t)key.head);
+  for (int out = 0; out < impulses.cabinetOutputs; out++)
+  {
+    status = status && (fwrite(impulses.cabinetHead[out].data(), sizeof(float), key.head, file) == (size_t)key.head);
+  }
+
+  std::vector<float> parts(2 * std::max(header.preampParts, header.cabinetParts));
+  fftwf_complex *part = (fftwf_complex *)parts.data();
+
+  status = status && !impulses.preamp.partdata_get(0, 0, part) &&
+    (fwrite(part, sizeof(fftwf_complex), header.preampParts, file) == header.preampParts);
+  for (int out = 0; out < impulses.cabinetOutputs; out++)
+  {
+    status = status && !impulses.cabinet.partdata_get(0, out, part) &&
+      (fwrite(part, sizeof(fftwf_complex), header.cabinetParts, file) == header.cabinetParts);
+  }
+
+  status = (fclose(file) == 0) && status;
+
+  if (!status || (rename(temp.c_str(), path.c_str()) != 0))
+  {
+    unlink(temp.c_str());
+    return;
+  }
+
+  evict(path.substr(0, path.rfind('/')), path);
+}
+
+void ProfileCache::evict(const std::string &dir, const std::string &keep)
+{
+  DIR *handle = opendir(dir.c_str());
+  if (!handle)
+  {
+    return;
+  }
+
+  struct CacheFile
+  {
+    std::string path;
+    time_t used;
+    uint64_t size;
+  };
+  std::vector<CacheFile> files;
+  uint64_t total = 0;
+  time_t now = time(nullptr);
+
+  while (struct dirent *entry = readdir(handle))
+  {
+    const char *name = entry->d_name;
+    const char *suffix = strstr(name, ".spectra");
+    if (!suffix)
+    {
+      continue;
+    }
+
+    std::string path = dir + "/" + name;
+    struct stat info;
+    if ((stat(path.c_str(), &info) != 0) || !S_ISREG(info.st_mode))
+    {
+      continue;
+    }
+
+    if (suffix[strlen(".spectra")] != '\0')
+    {
+      // Temporary file, name.spectra.XXXXXX
+      if (now - info.st_mtime > cacheTempAge)
+      {
+        unlink(path.c_str());
+      }
+      continue;
+    }
+
+    // Only the start of the header is the same in all versions
+    bool current = false;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file)
+    {
+      char signature[4];
+      uint32_t version[2];
+      current = (fread(signature, sizeof(signature), 1, file) == 1) &&
+        (fread(version, sizeof(version), 1, file) == 1) &&
+        !memcmp(signature, cacheSignature, 4) &&
+        (version[0] == cacheVersion) &&
+        (version[1] == sizeof(fftwf_complex));
+      fclose(file);
+    }
+
+    if (!current || ((path != keep) && (now - info.st_mtime > cacheMaxAge)))
+    {
+      unlink(path.c_str());
+      continue;
+    }
+
+    files.push_back({path, info.st_mtime, (uint64_t)info.st_size});
+    total += info.st_size;
+  }
+  closedir(handle);
+
+  // Least recently used files go first
+  std::sort(files.begin(), files.end(), [] (const CacheFile &a, const CacheFile &b) {
+    return a.used < b.used;
+  });
+
+  for (const CacheFile &file : files)
+  {
+    if (total <= cacheSizeLimit)
+    {
+      break;
+    }
+    if ((file.path != keep) && (unlink(file.path.c_str()) == 0))
+    {
+      total -= file.size;
+    }
+  }
+}
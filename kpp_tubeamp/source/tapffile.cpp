@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#include "../include/tapffile.h"
+#include "../../common/thirdparty/zita-resampler/resampler.h"
+
+#include <string.h>
+#include <math.h>
+
+bool TapfFile::open(const char *path)
+{
+  mPreamp = Impulse();
+  mCabinet[0] = Impulse();
+  mCabinet[1] = Impulse();
+  chunks.clear();
+  mContentHash = 0;
+  hashPos = 0;
+
+  if (!file.open(path))
+  {
+    return false;
+  }
+
+  if (!parse())
+  {
+    chunks.clear();
+    file.close();
+    return false;
+  }
+
+  return true;
+}
+
+bool TapfFile::parse()
+{
+  if ((file.size() < sizeof(st_profile_header)) ||
+      strncmp(file.data(), "TaPf", 4))
+  {
+    return false;
+  }
+  memcpy(&mHeader, file.data(), sizeof(st_profile_header));
+
+  // Layout of newer versions is unknown
+  if (mHeader.version > kVersion)
+  {
+    return false;
+  }
+
+  size_t pos = sizeof(st_profile_header);
+  int channel;
+
+  if (!readImpulse(pos, mPreamp, channel))
+  {
+    return false;
+  }
+
+  // One or two cabinet IRs follow, other channels are ignored.
+  // The chunk table may take the place of the second one.
+  size_t tablePos = 0;
+  for (int i = 0; i < 2; i++)
+  {
+    bool mono = (i == 1) && (mCabinet[0].count || mCabinet[1].count);
+    if (mono && (file.size() - pos < sizeof(st_impulse_header)))
+    {
+      break;
+    }
+
+    size_t start = pos;
+    Impulse impulse;
+    if (!readImpulse(pos, impulse, channel))
+    {
+      return false;
+    }
+    if ((channel == 0) || (channel == 1))
+    {
+      mCabinet[channel] = impulse;
+    }
+    else if ((channel == -1) && (mHeader.version >= 2))
+    {
+      tablePos = start;
+      break;
+    }
+  }
+
+  if (!mCabinet[0].count && !mCabinet[1].count)
+  {
+    return false;
+  }
+  if (!mCabinet[0].count)
+  {
+    mCabinet[0] = mCabinet[1];
+  }
+  if (!mCabinet[1].count)
+  {
+    mCabinet[1] = mCabinet[0];
+  }
+
+  if (mHeader.version >= 2)
+  {
+    return readTable(tablePos ? tablePos : pos);
+  }
+
+  return true;
+}
+
+// Impulse header and samples at 'pos', moves 'pos' past them.
+// Sample data is 4 byte aligned, as all headers are.
+bool TapfFile::readImpulse(size_t &pos, Impulse &impulse, int &channel)
+{
+  st_impulse_header impheader;
+  if (file.size() - pos < sizeof(st_impulse_header))
+  {
+    return false;
+  }
+  memcpy(&impheader, file.data() + pos, sizeof(st_impulse_header));
+  pos += sizeof(st_impulse_header);
+
+  if ((impheader.sample_count < 0) ||
+      ((size_t)impheader.sample_count > (file.size() - pos) / sizeof(float)))
+  {
+    return false;
+  }
+
+  impulse.data = (const float *)(file.data() + pos);
+  impulse.count = impheader.sample_count;
+  channel = impheader.channel;
+
+  pos += impulse.count * sizeof(float);
+  return true;
+}
+
+bool TapfFile::readTable(size_t pos)
+{
+  st_chunk_table_header table;
+  if (file.size() - pos < sizeof(st_chunk_table_header))
+  {
+    return false;
+  }
+  memcpy(&table, file.data() + pos, sizeof(st_chunk_table_header));
+
+  if (strncmp(table.signature, "TaPc", 4) || (table.impulse.channel != -1) ||
+      (table.chunk_count > (file.size() - pos - sizeof(st_chunk_table_header)) /
+                           sizeof(st_impulse_chunk)))
+  {
+    return false;
+  }
+
+  // Older readers skip exactly the table
+  size_t tableSize = sizeof(st_chunk_table_header) +
+    table.chunk_count * sizeof(st_impulse_chunk);
+  if ((size_t)table.impulse.sample_count * sizeof(float) !=
+      tableSize - sizeof(st_impulse_header))
+  {
+    return false;
+  }
+
+  mContentHash = table.content_hash;
+  hashPos = pos + offsetof(st_chunk_table_header, content_hash);
+
+  pos += sizeof(st_chunk_table_header);
+  for (uint32_t i = 0; i < table.chunk_count; i++)
+  {
+    st_impulse_chunk entry;
+    memcpy(&entry, file.data() + pos, sizeof(st_impulse_chunk));
+    pos += sizeof(st_impulse_chunk);
+
+    if ((entry.type > 1) || (entry.sample_rate == 0) ||
+        ((entry.type == 1) && (entry.channel > 1)) ||
+        (entry.offset % sizeof(float)) || (entry.offset > file.size()) ||
+        (entry.sample_count > (file.size() - entry.offset) / sizeof(float)) ||
+        (entry.trimmed_count > entry.sample_count))
+    {
+      return false;
+    }
+
+    Chunk chunk;
+    chunk.type = entry.type;
+    chunk.sampleRate = entry.sample_rate;
+    chunk.channel = entry.channel;
+    chunk.impulse.data = (const float *)(file.data() + entry.offset);
+    chunk.impulse.count = entry.sample_count;
+    chunk.impulse.trimmed = entry.trimmed_count;
+    chunk.impulse.trimDb = entry.trim_db;
+    chunks.push_back(chunk);
+  }
+
+  return true;
+}
+
+bool TapfFile::verify() const
+{
+  if (!mContentHash)
+  {
+    return true;
+  }
+
+  uint64_t h = hash(file.data(), hashPos);
+  size_t rest = hashPos + sizeof(uint64_t);
+  h = hash(file.data() + rest, file.size() - rest, h);
+
+  return h == mContentHash;
+}
+
+bool TapfFile::rendered(float sampleRate, Impulse &preamp, Impulse cabinet[2]) const
+{
+  bool hasPreamp = false;
+  cabinet[0] = Impulse();
+  cabinet[1] = Impulse();
+
+  for (const Chunk &chunk : chunks)
+  {
+    if ((float)chunk.sampleRate != sampleRate)
+    {
+      continue;
+    }
+
+    if (chunk.type == 0)
+    {
+      preamp = chunk.impulse;
+      hasPreamp = true;
+    }
+    else
+    {
+      cabinet[chunk.channel] = chunk.impulse;
+    }
+  }
+
+  if (!hasPreamp || (!cabinet[0].count && !cabinet[1].count))
+  {
+    return false;
+  }
+  if (!cabinet[0].count)
+  {
+    cabinet[0] = cabinet[1];
+  }
+  if (!cabinet[1].count)
+  {
+    cabinet[1] = cabinet[0];
+  }
+
+  return true;
+}
+
+uint64_t TapfFile::hash(const void *data, size_t size, uint64_t h)
+{
+  const unsigned char *bytes = (const unsigned char *)data;
+
+  for (size_t i = 0; i < size; i++)
+  {
+    h ^= bytes[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+size_t TapfFile::resampledCount(size_t count, float sampleRate)
+{
+  float ratio = sampleRate / 48000.0;
+  return (size_t)(count * ratio);
+}
+
+void TapfFile::resample(const float *const *impulses, int channels, size_t count,
+                        float sampleRate, float *const *resampled)
+{
+  float ratio = sampleRate / 48000.0;
+
+  Resampler resampl;
+  resampl.setup(48000, sampleRate, channels, 48);
+
+  int k = resampl.inpsize();
+  size_t padded = count + k/2 - 1 + k - 1;
+
+  // Create paddig before and after signal, needed for zita-resampler
+  std::vector<float> inp_data(padded * channels, 0.0);
+  for (size_t i = 0; i < count; i++)
+  {
+    for (int c = 0; c < channels; c++)
+    {
+      inp_data[(i + k/2 - 1) * channels + c] = impulses[c][i];
+    }
+  }
+
+  unsigned int out_count = (unsigned int)(padded * ratio);
+  std::vector<float> out_data(out_count * channels);
+
+  resampl.inp_count = padded;
+  resampl.out_count = out_count;
+  resampl.inp_data = inp_data.data();
+  resampl.out_data = out_data.data();
+
+  resampl.process();
+
+  size_t resampled_count = resampledCount(count, sampleRate);
+  for (size_t i = 0; i < resampled_count; i++)
+  {
+    for (int c = 0; c < channels; c++)
+    {
+      resampled[c][i] = out_data[i * channels + c] / ratio;
+    }
+  }
+}
+
+size_t TapfFile::trimmedLength(const float *impulse, size_t count, double thresholdDb)
+{
+  double total = 0.0;
+  for (size_t i = 0; i < count; i++)
+  {
+    total += (double)impulse[i] * impulse[i];
+  }
+
+  double limit = total * pow(10.0, thresholdDb / 10.0);
+
+  double tail = 0.0;
+  size_t length = count;
+  while (length > 1)
+  {
+    double s = impulse[length - 1];
+    if (tail + s * s > limit)
+    {
+      break;
+    }
+    tail += s * s;
+    length--;
+  }
+
+  return length;
+}
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 #include "zita-convolver.h"
 
 
@@ -69,7 +70,8 @@ Convproc::Convproc (void) :
     _minpart (0),
     _maxpart (0),
     _nlevels (0),
-    _latecnt (0)
+    _latecnt (0),
+    _pool (0)
 {
     memset (_inpbuff, 0, MAXINP * sizeof (float *));
     memset (_outbuff, 0, MAXOUT * sizeof (float *));
@@ -194,7 +196,7 @@ int Convproc::configure (uint32_t  ninp,
 int Convproc::impdata_create (uint32_t  inp,
                               uint32_t  out,
                               int32_t   step,
-                              float     *data,
+                              const float *data,
                               int32_t   ind0,
                               int32_t   ind1)
 {
@@ -231,7 +233,7 @@ int Convproc::impdata_clear (uint32_t inp, uint32_t out)
 int Convproc::impdata_update (uint32_t  inp,
                               uint32_t  out,
                               int32_t   step,
-                              float     *data, 
+                              const float *data, 
                               int32_t   ind0,
                               int32_t   ind1)
 {
@@ -274,6 +276,97 @@ int Convproc::impdata_link (uint32_t inp1,
 }
 
 
+int Convproc::impdata_link (const Convproc *src,
+                            uint32_t inp1,
+                            uint32_t out1,
+                            uint32_t inp2,
+                            uint32_t out2)
+{
+    uint32_t j;
+    Convlevel *L1, *L2;
+
+    if ((inp1 >= src->_ninp) || (out1 >= src->_nout)) return Converror::BAD_PARAM;
+    if ((inp2 >= _ninp) || (out2 >= _nout)) return Converror::BAD_PARAM;
+    if (src == this) return impdata_link (inp1, out1, inp2, out2);
+    if ((_state != ST_STOP) || (src->_state == ST_IDLE)) return Converror::BAD_STATE;
+    if ((src->_nlevels != _nlevels) || (src->_quantum != _quantum)) return Converror::BAD_PARAM;
+    for (j = 0; j < _nlevels; j++)
+    {
+        L1 = src->_convlev [j];
+        L2 = _convlev [j];
+        if (   (L1->_offs != L2->_offs)
+            || (L1->_npar != L2->_npar)
+            || (L1->_parsize != L2->_parsize)
+            || (L1->_options != L2->_options)) return Converror::BAD_PARAM;
+    }
+    try
+    {
+        for (j = 0; j < _nlevels; j++)
+	{
+            _convlev [j]->impdata_link (src->_convlev [j], inp1, out1, inp2, out2);
+	}
+    }
+    catch (...)
+    {
+	cleanup ();
+	return Converror::MEM_ALLOC;
+    }
+    return 0;
+}
+
+
+uint32_t Convproc::partdata_size (void) const
+{
+    uint32_t j, n;
+
+    for (j = n = 0; j < _nlevels; j++)
+    {
+        n += _convlev [j]->_npar * (_convlev [j]->_parsize + 1);
+    }
+    return n;
+}
+
+
+int Convproc::partdata_get (uint32_t       inp,
+                            uint32_t       out,
+                            fftwf_complex  *data) const
+{
+    uint32_t j;
+
+    if ((inp >= _ninp) || (out >= _nout)) return Converror::BAD_PARAM;
+    if (_state == ST_IDLE) return Converror::BAD_STATE;
+    for (j = 0; j < _nlevels; j++)
+    {
+        data += _convlev [j]->partdata_get (inp, out, data);
+    }
+    return 0;
+}
+
+
+int Convproc::partdata_set (uint32_t             inp,
+                            uint32_t             out,
+                            const fftwf_complex  *data)
+{
+    uint32_t j;
+
+    if ((inp >= _ninp) || (out >= _nout)) return Converror::BAD_PARAM;
+    if (_state != ST_STOP) return Converror::BAD_STATE;
+    try
+    {
+        for (j = 0; j < _nlevels; j++)
+        {
+            data += _convlev [j]->partdata_set (inp, out, data);
+        }
+    }
+    catch (...)
+    {
+	cleanup ();
+	return Converror::MEM_ALLOC;
+    }
+    return 0;
+}
+
+
 int Convproc::reset (void)
 {
     uint32_t k;
@@ -286,7 +379,28 @@ int Convproc::reset (void)
 }
 
 
-int Convproc::start_process (int abspri, int policy)
+int Convproc::start_process (int abspri, int policy, uint32_t fsamp)
+{
+    uint32_t k, k0;
+
+    if (_state != ST_STOP) return Converror::BAD_STATE;
+    _latecnt = 0;
+    _inpoffs = 0;
+    _outoffs = 0;
+    reset ();
+
+    k0 = (_minpart == _quantum) ? 1 : 0;
+    if ((k0 < _nlevels) && !_pool) _pool = Convpool::acquire (abspri, policy);
+    for (k = k0; k < _nlevels; k++)
+    {
+        _convlev [k]->start (_pool->band (_convlev [k]->_prio), fsamp);
+    }
+    _state = ST_PROC;
+    return 0;
+}
+
+
+int Convproc::start_inline (void)
 {
     uint32_t k;
 
@@ -298,7 +412,7 @@ int Convproc::start_process (int abspri, int policy)
 
     for (k = (_minpart == _quantum) ? 1 : 0; k < _nlevels; k++)
     {
-        _convlev [k]->start (abspri, policy);
+        _convlev [k]->start_inline ();
     }
     _state = ST_PROC;
     return 0;
@@ -354,6 +468,11 @@ int Convproc::cleanup (void)
     {
         usleep (100000);
     }
+    if (_pool)
+    {
+        Convpool::release ();
+        _pool = 0;
+    }
     for (k = 0; k < _ninp; k++)
     {
         delete[] _inpbuff [k];
@@ -388,6 +507,7 @@ bool Convproc::check_stop (void)
 {
     uint32_t k;
 
+    // Levels become idle after their last access by a worker
     for (k = 0; (k < _nlevels) && (_convlev [k]->_stat == Convlevel::ST_IDLE); k++);
     if (k == _nlevels)
     {
@@ -407,15 +527,334 @@ void Convproc::print (FILE *F)
 
 
 
+pthread_mutex_t Convpool::_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+Convpool *Convpool::_pool = 0;
+uint32_t Convpool::_users = 0;
+
+
+static int64_t monotonic_ns (void)
+{
+    struct timespec t;
+
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return (int64_t) t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+
+Convpool::Convpool (int abspri, int policy) :
+    _abspri (abspri),
+    _policy (policy)
+{
+    long ncpu;
+
+    // One processor is left to the audio thread
+    ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+    _nthr = (ncpu > 1) ? ncpu - 1 : 1;
+    if (_nthr > Convband::MAXTHR) _nthr = Convband::MAXTHR;
+    memset (_band, 0, sizeof (_band));
+}
+
+
+Convpool::~Convpool (void)
+{
+    for (uint32_t b = 0; b < MAXBAND; b++) delete _band [b];
+}
+
+
+Convpool *Convpool::acquire (int abspri, int policy)
+{
+    Convpool *P;
+
+    pthread_mutex_lock (&_pool_mutex);
+    if (!_pool) _pool = new Convpool (abspri, policy);
+    _users++;
+    P = _pool;
+    pthread_mutex_unlock (&_pool_mutex);
+    return P;
+}
+
+
+void Convpool::release (void)
+{
+    pthread_mutex_lock (&_pool_mutex);
+    if (--_users == 0)
+    {
+        delete _pool;
+        _pool = 0;
+    }
+    pthread_mutex_unlock (&_pool_mutex);
+}
+
+
+// Relative priorities are 0 for the shortest partitions
+// and decrease with the partition size
+Convband *Convpool::band (int prio)
+{
+    Convband *B;
+    uint32_t b;
+
+    b = (prio < 0) ? -prio : 0;
+    if (b >= MAXBAND) b = MAXBAND - 1;
+    pthread_mutex_lock (&_pool_mutex);
+    if (!_band [b])
+    {
+        _band [b] = new Convband ();
+        _band [b]->start (_abspri - (int) b, _policy, _nthr);
+    }
+    B = _band [b];
+    pthread_mutex_unlock (&_pool_mutex);
+    return B;
+}
+
+
+Convband::Convband (void) :
+    _incoming (0),
+    _nlev (0),
+    _heap (0),
+    _nheap (0),
+    _size (0),
+    _nthr (0),
+    _quit (false)
+{
+    pthread_mutex_init (&_mutex, 0);
+    _jobs.init (0, 0);
+}
+
+
+Convband::~Convband (void)
+{
+    join ();
+    delete[] _heap;
+    pthread_mutex_destroy (&_mutex);
+}
+
+
+void Convband::start (int abspri, int policy, uint32_t nthr)
+{
+    int                min, max;
+    pthread_attr_t     attr;
+    struct sched_param parm;
+
+    min = sched_get_priority_min (policy);
+    max = sched_get_priority_max (policy);
+    if (abspri > max) abspri = max;
+    if (abspri < min) abspri = min;
+    parm.sched_priority = abspri;
+
+    for (_nthr = 0; _nthr < nthr; _nthr++)
+    {
+        pthread_attr_init (&attr);
+        pthread_attr_setschedpolicy (&attr, policy);
+        pthread_attr_setschedparam (&attr, &parm);
+        pthread_attr_setscope (&attr, PTHREAD_SCOPE_SYSTEM);
+        pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setstacksize (&attr, 0x10000);
+        if (pthread_create (&_thr [_nthr], &attr, static_main, this))
+        {
+            // No permission for the policy, inherit the caller's
+            pthread_attr_setinheritsched (&attr, PTHREAD_INHERIT_SCHED);
+            if (pthread_create (&_thr [_nthr], &attr, static_main, this))
+            {
+                pthread_attr_destroy (&attr);
+                break;
+            }
+        }
+        pthread_attr_destroy (&attr);
+    }
+}
+
+
+void Convband::join (void)
+{
+    uint32_t i;
+
+    pthread_mutex_lock (&_mutex);
+    _quit = true;
+    pthread_mutex_unlock (&_mutex);
+    for (i = 0; i < _nthr; i++) _jobs.post ();
+    for (i = 0; i < _nthr; i++) pthread_join (_thr [i], 0);
+    _nthr = 0;
+}
+
+
+// Called by Convlevel::start(), outside of the audio thread
+void Convband::add (Convlevel *L)
+{
+    Convlevel **H;
+    uint32_t  n;
+
+    pthread_mutex_lock (&_mutex);
+    n = ++_nlev;
+    if (n > _size)
+    {
+        H = new Convlevel * [2 * n];
+        if (_nheap) memcpy (H, _heap, _nheap * sizeof (Convlevel *));
+        delete[] _heap;
+        _heap = H;
+        _size = 2 * n;
+    }
+    L->_njobs = 0;
+    L->_stat = Convlevel::ST_PROC;
+    pthread_mutex_unlock (&_mutex);
+}
+
+
+// Called by the audio thread, lock free. A level is queued at
+// most once, cycles triggered while it is queued or running
+// follow one period apart.
+void Convband::submit (Convlevel *L)
+{
+    Convlevel *H;
+
+    if (L->_njobs.fetch_add (1, std::memory_order_acq_rel) & ~Convlevel::JOB_TERM) return;
+    L->_deadline = monotonic_ns () + L->_period;
+    H = _incoming.load (std::memory_order_relaxed);
+    do L->_next = H;
+    while (! _incoming.compare_exchange_weak (H, L, std::memory_order_release,
+                                              std::memory_order_relaxed));
+    _jobs.post ();
+}
+
+
+// Lock free, as Convproc::process() stops late convolvers.
+// The level becomes idle when its last cycle is done.
+void Convband::stop (Convlevel *L)
+{
+    uint32_t n;
+
+    L->_stat = Convlevel::ST_TERM;
+    n = L->_njobs.fetch_or (Convlevel::JOB_TERM, std::memory_order_acq_rel);
+    if (n & Convlevel::JOB_TERM) return;
+    if (n == 0) finish (L);
+}
+
+
+// Level may be deleted as soon as it is idle
+void Convband::finish (Convlevel *L)
+{
+    _nlev--;
+    L->_stat.store (Convlevel::ST_IDLE, std::memory_order_release);
+}
+
+
+// Moves the triggered levels to the heap, with the mutex locked.
+// Only one worker at a time takes the list, so it is not
+// subject to ABA.
+void Convband::collect (void)
+{
+    Convlevel *L, *N;
+
+    L = _incoming.exchange (0, std::memory_order_acquire);
+    while (L)
+    {
+        N = L->_next;
+        push (L);
+        L = N;
+    }
+}
+
+
+void Convband::push (Convlevel *L)
+{
+    uint32_t i, j;
+
+    i = _nheap++;
+    while (i)
+    {
+        j = (i - 1) / 2;
+        if (_heap [j]->_deadline <= L->_deadline) break;
+        _heap [i] = _heap [j];
+        i = j;
+    }
+    _heap [i] = L;
+}
+
+
+Convlevel *Convband::pop (void)
+{
+    uint32_t  i, j;
+    Convlevel *L, *T;
+
+    L = _heap [0];
+    T = _heap [--_nheap];
+    i = 0;
+    while ((j = 2 * i + 1) < _nheap)
+    {
+        if ((j + 1 < _nheap) && (_heap [j + 1]->_deadline < _heap [j]->_deadline)) j++;
+        if (T->_deadline <= _heap [j]->_deadline) break;
+        _heap [i] = _heap [j];
+        i = j;
+    }
+    _heap [i] = T;
+    return L;
+}
+
+
+void *Convband::static_main (void *arg)
+{
+    ((Convband *) arg)->main ();
+    return 0;
+}
+
+
+// Every queued level is posted once after it is pushed to
+// _incoming, so the heap is not empty after a wait.
+void Convband::main (void)
+{
+    Convlevel  *L;
+    uint32_t   n;
+
+    while (true)
+    {
+        _jobs.wait ();
+        pthread_mutex_lock (&_mutex);
+        if (_quit)
+        {
+            pthread_mutex_unlock (&_mutex);
+            return;
+        }
+        collect ();
+        L = pop ();
+        pthread_mutex_unlock (&_mutex);
+
+        L->process (false);
+        L->_done.post ();
+
+        n = L->_njobs.fetch_sub (1, std::memory_order_acq_rel);
+        if ((n & ~Convlevel::JOB_TERM) > 1)
+        {
+            // Cycles triggered meanwhile, the level is still
+            // counted so submit() leaves it to this worker
+            L->_deadline += L->_period;
+            pthread_mutex_lock (&_mutex);
+            push (L);
+            pthread_mutex_unlock (&_mutex);
+            _jobs.post ();
+        }
+        else if (n & Convlevel::JOB_TERM)
+        {
+            finish (L);
+        }
+    }
+}
+
+
+
 typedef float FV4 __attribute__ ((vector_size(16)));
 
 
+pthread_mutex_t Convlevel::_plan_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
 Convlevel::Convlevel (void) :
     _stat (ST_IDLE),
     _npar (0),
     _parsize (0),
     _options (0),
-    _pthr (0),
+    _inline (false),
+    _band (0),
+    _njobs (0),
+    _next (0),
     _inp_list (0),
     _out_list (0),
     _plan_r2c (0),
@@ -451,8 +890,12 @@ void Convlevel::configure (int       prio,
     _time_data = calloc_real (2 * _parsize);
     _prep_data = calloc_real (2 * _parsize);
     _freq_data = calloc_complex (_parsize + 1);
+    // Convolvers of all instances are configured
+    // and deleted on different threads
+    pthread_mutex_lock (&_plan_mutex);
     _plan_r2c = fftwf_plan_dft_r2c_1d (2 * _parsize, _time_data, _freq_data, fftwopt);
     _plan_c2r = fftwf_plan_dft_c2r_1d (2 * _parsize, _freq_data, _time_data, fftwopt);
+    pthread_mutex_unlock (&_plan_mutex);
     if (_plan_r2c && _plan_c2r) return;
     throw (Converror (Converror::MEM_ALLOC));
 }
@@ -461,7 +904,7 @@ void Convlevel::configure (int       prio,
 void Convlevel::impdata_write (uint32_t  inp,
                                uint32_t  out,
                                int32_t   step,
-                               float     *data,
+                               const float *data,
                                int32_t   i0,
                                int32_t   i1,
                                bool      create)
@@ -555,6 +998,66 @@ void Convlevel::impdata_link (uint32_t inp1,
 }
 
 
+void Convlevel::impdata_link (const Convlevel *src,
+                              uint32_t inp1,
+                              uint32_t out1,
+                              uint32_t inp2,
+                              uint32_t out2)
+{
+    Macnode  *M1;
+    Macnode  *M2;
+
+    // Not modified when nothing is created
+    M1 = const_cast<Convlevel *> (src)->findmacnode (inp1, out1, false);
+    if (! M1) return;
+    M2 = findmacnode (inp2, out2, true);
+    M2->free_fftb ();	
+    M2->_link = M1->_link ? M1->_link : M1;
+}
+
+
+// Missing partitions are given as zeros
+uint32_t Convlevel::partdata_get (uint32_t       inp,
+                                  uint32_t       out,
+                                  fftwf_complex  *data) const
+{
+    uint32_t       k, n;
+    Macnode        *M;
+    fftwf_complex  *fftb;
+
+    n = _parsize + 1;
+    M = const_cast<Convlevel *> (this)->findmacnode (inp, out, false);
+    if (M && M->_link) M = M->_link;
+    for (k = 0; k < _npar; k++)
+    {
+        fftb = (M && M->_fftb) ? M->_fftb [k] : 0;
+        if (fftb) memcpy (data + k * n, fftb, n * sizeof (fftwf_complex));
+        else memset (data + k * n, 0, n * sizeof (fftwf_complex));
+    }
+    return _npar * n;
+}
+
+
+uint32_t Convlevel::partdata_set (uint32_t             inp,
+                                  uint32_t             out,
+                                  const fftwf_complex  *data)
+{
+    uint32_t       k, n;
+    Macnode        *M;
+
+    n = _parsize + 1;
+    M = findmacnode (inp, out, true);
+    if (M->_link) return _npar * n;
+    if (M->_fftb == 0) M->alloc_fftb (_npar);
+    for (k = 0; k < _npar; k++)
+    {
+        if (M->_fftb [k] == 0) M->_fftb [k] = calloc_complex (n);
+        memcpy (M->_fftb [k], data + k * n, n * sizeof (fftwf_complex));
+    }
+    return _npar * n;
+}
+
+
 void Convlevel::reset (uint32_t  inpsize,
                        uint32_t  outsize,
 		       float         **inpbuff,
@@ -596,43 +1099,30 @@ void Convlevel::reset (uint32_t  inpsize,
     _wait = 0;
     _ptind = 0;
     _opind = 0;
-    _trig.init (0, 0);
     _done.init (0, 0);
 }
 
 
-void Convlevel::start (int abspri, int policy)
+void Convlevel::start (Convband *band, uint32_t fsamp)
 {
-    int                min, max;
-    pthread_attr_t     attr;
-    struct sched_param parm;
+    _inline = false;
+    _band = band;
+    _period = fsamp ? (int64_t) _parsize * 1000000000LL / fsamp : 0;
+    band->add (this);
+}
 
-    _pthr = 0;
-    min = sched_get_priority_min (policy);
-    max = sched_get_priority_max (policy);
-    abspri += _prio;
-    if (abspri > max) abspri = max;
-    if (abspri < min) abspri = min;
-    parm.sched_priority = abspri;
-    pthread_attr_init (&attr);
-    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
-    pthread_attr_setschedpolicy (&attr, policy);
-    pthread_attr_setschedparam (&attr, &parm);
-    pthread_attr_setscope (&attr, PTHREAD_SCOPE_SYSTEM);
-    pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED);
-    pthread_attr_setstacksize (&attr, 0x10000);
-    pthread_create (&_pthr, &attr, static_main, this);
-    pthread_attr_destroy (&attr);
+
+// The level is processed by readout() one cycle later than
+// it would be by its thread, as if the thread finished at once.
+void Convlevel::start_inline (void)
+{
+    _inline = true;
 }
 
 
 void Convlevel::stop (void)
 {
-    if (_stat != ST_IDLE)
-    {
-        _stat = ST_TERM;
-	_trig.post ();
-    }
+    if (_stat != ST_IDLE) _band->stop (this);
 }
 
 
@@ -667,8 +1157,10 @@ void Convlevel::cleanup (void)
     }
     _out_list = 0;
 
-    fftwf_destroy_plan (_plan_r2c);
-    fftwf_destroy_plan (_plan_c2r);
+    pthread_mutex_lock (&_plan_mutex);
+    if (_plan_r2c) fftwf_destroy_plan (_plan_r2c);
+    if (_plan_c2r) fftwf_destroy_plan (_plan_c2r);
+    pthread_mutex_unlock (&_plan_mutex);
     fftwf_free (_time_data);
     fftwf_free (_prep_data);
     fftwf_free (_freq_data);
@@ -680,31 +1172,6 @@ void Convlevel::cleanup (void)
 }
 
 
-void *Convlevel::static_main (void *arg)
-{
-    ((Convlevel *) arg)->main ();
-    return 0;
-}
-
-
-void Convlevel::main (void)
-{
-    _stat = ST_PROC;
-    while (true)
-    {
-	_trig.wait ();
-	if (_stat == ST_TERM)
-	{
-            _stat = ST_IDLE;
-	    _pthr = 0;
-            return;
-        }
-	process (false);
-	_done.post ();
-    }
-}
-
-
 void Convlevel::process (bool skip)
 {
     uint32_t        i, i1, j, k, n1, n2, opi1, opi2;
@@ -832,9 +1299,14 @@ int Convlevel::readout (bool sync, uint32_t skipcnt)
   	        _wait--;
 	    }
 	    if (++_opind == 3) _opind = 0;
-            _trig.post ();
+            _band->submit (this);
 	    _wait++;
 	}
+	else if (_inline)
+	{
+	    if (++_opind == 3) _opind = 0;
+	    process (false);
+	}
         else
 	{
             process (skipcnt >= 2 * _parsize);
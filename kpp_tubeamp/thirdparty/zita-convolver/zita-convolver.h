@@ -25,6 +25,7 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <fftw3.h>
+#include <atomic>
 
 
 #define ZITA_CONVOLVER_MAJOR_VERSION 4
@@ -226,11 +227,119 @@ private:
 };
 
 
+class Convlevel;
+
+
+// Workers of one priority band, one less than the number of
+// processors. Levels with the same relative priority, that is the
+// same partition size class, are run by the same band. A level
+// queues a cycle when it is triggered, its deadline is the end of
+// the partition period in which the cycle must be ready. Workers
+// run queued cycles earliest deadline first.
+//
+// The audio thread never locks. Triggered levels are pushed to a
+// lock-free list, workers move them to the deadline heap under
+// a mutex that only the workers of the band use.
+
+class Convband
+{
+private:
+
+    friend class Convlevel;
+    friend class Convpool;
+    friend class Convproc;
+
+    enum { MAXTHR = 16 };
+
+    Convband (void);
+    ~Convband (void);
+
+    Convband (const Convband&); // disabled
+    Convband& operator= (const Convband&); // disabled
+
+    void start (int abspri, int policy, uint32_t nthr);
+
+    void join (void);
+
+    void add (Convlevel *L);
+
+    void submit (Convlevel *L);
+
+    void stop (Convlevel *L);
+
+    void finish (Convlevel *L);
+
+    void collect (void);
+
+    void push (Convlevel *L);
+
+    Convlevel *pop (void);
+
+    static void *static_main (void *arg);
+
+    void main (void);
+
+    std::atomic<Convlevel *>  _incoming;  // triggered levels, not yet in the heap
+    std::atomic<uint32_t>     _nlev;      // levels not yet idle
+    pthread_mutex_t     _mutex;          // protects everything below
+    ZCsema              _jobs;           // one count per queued level
+    Convlevel         **_heap;           // queued levels, binary heap
+    uint32_t            _nheap;          // number of queued levels
+    uint32_t            _size;           // heap capacity
+    uint32_t            _nthr;           // number of workers
+    pthread_t           _thr [MAXTHR];   // workers
+    bool                _quit;           // workers must exit
+};
+
+
+// Worker bands shared by the levels of all Convproc instances
+// in the process. A band is started when the first level of its
+// priority is started, at the absolute priority plus the level's
+// relative one, so long partitions run below short ones.
+
+class Convpool
+{
+private:
+
+    friend class Convlevel;
+    friend class Convproc;
+
+    enum { MAXBAND = 16 };
+
+    Convpool (int abspri, int policy);
+    ~Convpool (void);
+
+    Convpool (const Convpool&); // disabled
+    Convpool& operator= (const Convpool&); // disabled
+
+    // Shared instance, created by the first user with
+    // its priority and policy, deleted by the last one
+    static Convpool *acquire (int abspri, int policy);
+    static void release (void);
+
+    // Called outside of the audio thread
+    Convband *band (int prio);
+
+    int                 _abspri;         // priority of relative priority 0
+    int                 _policy;         // scheduling policy
+    uint32_t            _nthr;           // workers per band
+    Convband           *_band [MAXBAND]; // bands by relative priority
+
+    static pthread_mutex_t  _pool_mutex; // protects the shared instance and its bands
+    static Convpool        *_pool;       // shared instance
+    static uint32_t         _users;      // Convproc instances using it
+};
+
+
+// ----------------------------------------------------------------------------
+
+
 class Convlevel
 {
 private:
 
     friend class Convproc;
+    friend class Convband;
 
     enum 
     {
@@ -246,6 +355,9 @@ private:
         ST_PROC
     };
 
+    // Stop flag in _njobs, below it the count
+    enum { JOB_TERM = 0x80000000 };
+
     Convlevel (void);
     ~Convlevel (void);
 
@@ -258,7 +370,7 @@ private:
     void impdata_write (uint32_t  inp,
                         uint32_t  out,
                         int32_t   step,
-                        float     *data,
+                        const float *data,
                         int32_t   ind0,
                         int32_t   ind1,
                         bool      create);
@@ -271,12 +383,28 @@ private:
                        uint32_t  inp2,
                        uint32_t  out2);
 
+    void impdata_link (const Convlevel *src,
+                       uint32_t  inp1,
+                       uint32_t  out1,
+                       uint32_t  inp2,
+                       uint32_t  out2);
+
+    uint32_t partdata_get (uint32_t       inp,
+                           uint32_t       out,
+                           fftwf_complex  *data) const;
+
+    uint32_t partdata_set (uint32_t             inp,
+                           uint32_t             out,
+                           const fftwf_complex  *data);
+
     void reset (uint32_t  inpsize,
                 uint32_t  outsize,
 	        float     **inpbuff,
 	        float     **outbuff);
 
-    void start (int absprio, int policy);
+    void start (Convband *band, uint32_t fsamp);
+
+    void start_inline (void);
 
     void process (bool sync);
 
@@ -290,14 +418,10 @@ private:
 
     void print (FILE *F);
 
-    static void *static_main (void *arg);
-
-    void main (void);
-
     Macnode *findmacnode (uint32_t inp, uint32_t out, bool create);
 
 
-    volatile uint32_t   _stat;           // current processing state
+    std::atomic<uint32_t>  _stat;        // current processing state
     int                 _prio;           // relative priority
     uint32_t            _offs;           // offset from start of impulse response
     uint32_t            _npar;           // number of partitions
@@ -311,8 +435,12 @@ private:
     uint32_t            _opind;          // rotating output buffer index
     int                 _bits;           // bit identifiying this level
     int                 _wait;           // number of unfinished cycles
-    pthread_t           _pthr;           // posix thread executing this level
-    ZCsema              _trig;           // sema used to trigger a cycle
+    bool                _inline;         // thread level run by readout()
+    Convband           *_band;           // workers executing this level
+    int64_t             _period;         // partition period, nanoseconds
+    int64_t             _deadline;       // end of the queued cycle's period
+    std::atomic<uint32_t>  _njobs;       // queued and running cycles, JOB_TERM
+    Convlevel          *_next;           // next in Convband::_incoming
     ZCsema              _done;           // sema used to wait for a cycle
     Inpnode            *_inp_list;       // linked list of active inputs
     Outnode            *_out_list;       // linked list of active outputs
@@ -323,6 +451,8 @@ private:
     fftwf_complex      *_freq_data;      // workspace
     float             **_inpbuff;        // array of shared input buffers
     float             **_outbuff;        // array of shared output buffers
+
+    static pthread_mutex_t  _plan_mutex; // FFTW planner is not thread safe
 };
 
 
@@ -395,7 +525,7 @@ public:
     int impdata_create (uint32_t  inp,
                         uint32_t  out,
                         int32_t   step,
-                        float     *data,
+                        const float *data,
                         int32_t   ind0,
                         int32_t   ind1); 
 
@@ -405,7 +535,7 @@ public:
     int impdata_update (uint32_t  inp,
                         uint32_t  out,
                         int32_t   step,
-                        float     *data,
+                        const float *data,
                         int32_t   ind0,
                         int32_t   ind1); 
 
@@ -414,6 +544,32 @@ public:
                       uint32_t  inp2,
                       uint32_t  out2);
 
+    // Links (inp2, out2) to the partitions of (inp1, out1)
+    // in 'src', which must be configured with the same
+    // parameters and be kept until this is cleaned up.
+    // Partitions are only read, so any number of
+    // convolvers may share them.
+    int impdata_link (const Convproc *src,
+                      uint32_t  inp1,
+                      uint32_t  out1,
+                      uint32_t  inp2,
+                      uint32_t  out2);
+
+    // IR partitions as transformed by impdata_create(),
+    // partdata_size() complex values per (inp, out).
+    // partdata_set() restores them in a convolver configured
+    // with the same parameters, no FFTs are done. Values are
+    // specific to the FFTW build and options.
+    uint32_t partdata_size (void) const;
+
+    int partdata_get (uint32_t       inp,
+                      uint32_t       out,
+                      fftwf_complex  *data) const;
+
+    int partdata_set (uint32_t             inp,
+                      uint32_t             out,
+                      const fftwf_complex  *data);
+
     // Deprecated, use impdata_link() instead.
     int impdata_copy (uint32_t  inp1,
                       uint32_t  out1,
@@ -429,7 +585,15 @@ public:
 
     int  reset (void);
 
-    int  start_process (int abspri, int policy);
+    // Levels that do not run in process() are queued to the
+    // bands of the shared Convpool. 'fsamp' converts partition
+    // sizes to the deadlines of their cycles.
+    int  start_process (int abspri, int policy, uint32_t fsamp = 48000);
+
+    // Like start_process(), but no threads are created and all
+    // levels run in process(). Output is the same as with
+    // start_process() and process (true).
+    int  start_inline (void);
 
     int  process (bool sync = false);
 
@@ -459,6 +623,7 @@ private:
     uint32_t    _inpsize;                 // size of input buffers
     uint32_t    _latecnt;                 // count of cycles ending too late
     Convlevel  *_convlev [MAXLEV];        // array of processors 
+    Convpool   *_pool;                    // shared workers, if used
     void       *_dummy [64];
 
     static float  _mac_cost;
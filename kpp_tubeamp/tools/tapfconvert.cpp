@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+// Converts *.tapf profiles to version 2, with the IRs
+// pre-rendered for common sample rates:
+//
+//   kpp_tapfconvert input.tapf output.tapf [rate ...]
+//
+// Default rates are 44100, 48000, 88200, 96000 and 192000 Hz.
+// IRs are rendered exactly as tubeAmp resamples them, along
+// with the trimmed cabinet IR lengths. 48000 Hz chunks point
+// to the IRs of the profile body, which stay at 48000 Hz.
+// Output may replace the input.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+#include <string>
+
+#include "../include/tapffile.h"
+
+// CABINET_TAIL_TRIM_DB of the plugin
+static const float kTrimDb = -90.0;
+
+struct RenderedImpulse
+{
+  uint32_t type;
+  uint32_t sampleRate;
+  uint32_t channel;
+  std::vector<float> samples;   // Empty when 'bodyPos' is used
+  size_t bodyPos;
+  size_t count;
+  size_t trimmed;
+};
+
+static size_t append(std::vector<char> &out, const void *data, size_t size)
+{
+  size_t pos = out.size();
+  out.insert(out.end(), (const char *)data, (const char *)data + size);
+  return pos;
+}
+
+// Returns the position of the samples
+static size_t append_impulse(std::vector<char> &out, int channel,
+                             const TapfFile::Impulse &impulse)
+{
+  st_impulse_header impheader;
+  impheader.sample_rate = 48000;
+  impheader.channel = channel;
+  impheader.sample_count = impulse.count;
+  append(out, &impheader, sizeof(st_impulse_header));
+
+  return append(out, impulse.data, impulse.count * sizeof(float));
+}
+
+static RenderedImpulse body_impulse(uint32_t type, uint32_t channel,
+                                    const TapfFile::Impulse &impulse, size_t pos)
+{
+  RenderedImpulse rendered;
+  rendered.type = type;
+  rendered.sampleRate = 48000;
+  rendered.channel = channel;
+  rendered.bodyPos = pos;
+  rendered.count = impulse.count;
+  rendered.trimmed = (type == 1) ?
+    TapfFile::trimmedLength(impulse.data, impulse.count, kTrimDb) : 0;
+  return rendered;
+}
+
+static RenderedImpulse new_impulse(uint32_t type, uint32_t sampleRate, uint32_t channel,
+                                   std::vector<float> &&samples)
+{
+  RenderedImpulse rendered;
+  rendered.type = type;
+  rendered.sampleRate = sampleRate;
+  rendered.channel = channel;
+  rendered.samples = std::move(samples);
+  rendered.bodyPos = 0;
+  rendered.count = rendered.samples.size();
+  rendered.trimmed = (type == 1) ?
+    TapfFile::trimmedLength(rendered.samples.data(), rendered.count, kTrimDb) : 0;
+  return rendered;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "Usage: %s input.tapf output.tapf [rate ...]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<uint32_t> rates;
+  for (int i = 3; i < argc; i++)
+  {
+    int rate = atoi(argv[i]);
+    if (rate <= 0)
+    {
+      fprintf(stderr, "Invalid sample rate: %s\n", argv[i]);
+      return 1;
+    }
+    rates.push_back(rate);
+  }
+  if (rates.empty())
+  {
+    rates = {44100, 48000, 88200, 96000, 192000};
+  }
+
+  TapfFile input;
+  if (!input.open(argv[1]) || !input.verify())
+  {
+    fprintf(stderr, "%s is not a valid *.tapf profile\n", argv[1]);
+    return 1;
+  }
+
+  // Body readable by version 1 loaders
+  std::vector<char> out;
+
+  st_profile_header header = input.header();
+  header.version = TapfFile::kVersion;
+  append(out, &header, sizeof(st_profile_header));
+
+  const TapfFile::Impulse &preamp = input.preamp();
+  const TapfFile::Impulse &left = input.cabinet(0);
+  const TapfFile::Impulse &right = input.cabinet(1);
+
+  // Cabinet IRs as tubeAmp prepares them: the shorter one
+  // padded, identical ones resampled as one channel
+  size_t cabinet_count = std::max(left.count, right.count);
+  std::vector<float> left_padded(left.data, left.data + left.count);
+  std::vector<float> right_padded(right.data, right.data + right.count);
+  left_padded.resize(cabinet_count, 0.0);
+  right_padded.resize(cabinet_count, 0.0);
+  bool cabinetMono = (left_padded == right_padded);
+
+  // Version 1 loaders read exactly two cabinet IRs and take
+  // the length of both from the last one, so the body always
+  // has both channels, padded, mono ones duplicated
+  TapfFile::Impulse leftBody;
+  leftBody.data = left_padded.data();
+  leftBody.count = cabinet_count;
+  TapfFile::Impulse rightBody;
+  rightBody.data = right_padded.data();
+  rightBody.count = cabinet_count;
+
+  size_t preampPos = append_impulse(out, 0, preamp);
+  size_t leftPos = append_impulse(out, 0, leftBody);
+  size_t rightPos = append_impulse(out, 1, rightBody);
+
+  std::vector<RenderedImpulse> impulses;
+  for (uint32_t rate : rates)
+  {
+    if (rate == 48000)
+    {
+      impulses.push_back(body_impulse(0, 0, preamp, preampPos));
+      impulses.push_back(body_impulse(1, 0, leftBody, leftPos));
+      if (!cabinetMono)
+      {
+        impulses.push_back(body_impulse(1, 1, rightBody, rightPos));
+      }
+      continue;
+    }
+
+    std::vector<float> preamp_resampled(TapfFile::resampledCount(preamp.count, rate));
+    float *preamp_out = preamp_resampled.data();
+    TapfFile::resample(&preamp.data, 1, preamp.count, rate, &preamp_out);
+    impulses.push_back(new_impulse(0, rate, 0, std::move(preamp_resampled)));
+
+    size_t count = TapfFile::resampledCount(cabinet_count, rate);
+    std::vector<float> left_resampled(count);
+    std::vector<float> right_resampled(cabinetMono ? 0 : count);
+
+    const float *inp[2] = {left_padded.data(), right_padded.data()};
+    float *cabinet_out[2] = {left_resampled.data(), right_resampled.data()};
+    TapfFile::resample(inp, cabinetMono ? 1 : 2, cabinet_count, rate, cabinet_out);
+
+    impulses.push_back(new_impulse(1, rate, 0, std::move(left_resampled)));
+    if (!cabinetMono)
+    {
+      impulses.push_back(new_impulse(1, rate, 1, std::move(right_resampled)));
+    }
+  }
+
+  // Chunk table, then the samples of new IRs
+  size_t tablePos = out.size();
+  size_t tableSize = sizeof(st_chunk_table_header) +
+    impulses.size() * sizeof(st_impulse_chunk);
+
+  st_chunk_table_header table;
+  memset(&table, 0, sizeof(st_chunk_table_header));
+  table.impulse.sample_rate = 0;
+  table.impulse.channel = -1;
+  table.impulse.sample_count = (tableSize - sizeof(st_impulse_header)) / sizeof(float);
+  memcpy(table.signature, "TaPc", 4);
+  table.chunk_count = impulses.size();
+
+  size_t samplesPos = tablePos + tableSize;
+  std::vector<st_impulse_chunk> entries;
+  for (const RenderedImpulse &impulse : impulses)
+  {
+    st_impulse_chunk entry;
+    entry.type = impulse.type;
+    entry.sample_rate = impulse.sampleRate;
+    entry.channel = impulse.channel;
+    entry.sample_count = impulse.count;
+    entry.trimmed_count = impulse.trimmed;
+    entry.trim_db = kTrimDb;
+    if (impulse.samples.empty())
+    {
+      entry.offset = impulse.bodyPos;
+    }
+    else
+    {
+      entry.offset = samplesPos;
+      samplesPos += impulse.count * sizeof(float);
+    }
+    entries.push_back(entry);
+  }
+
+  append(out, &table, sizeof(st_chunk_table_header));
+  append(out, entries.data(), entries.size() * sizeof(st_impulse_chunk));
+  for (const RenderedImpulse &impulse : impulses)
+  {
+    append(out, impulse.samples.data(), impulse.samples.size() * sizeof(float));
+  }
+
+  // Hash of everything but the hash itself
+  size_t hashPos = tablePos + offsetof(st_chunk_table_header, content_hash);
+  size_t rest = hashPos + sizeof(uint64_t);
+  uint64_t hash = TapfFile::hash(out.data(), hashPos);
+  hash = TapfFile::hash(out.data() + rest, out.size() - rest, hash);
+  memcpy(out.data() + hashPos, &hash, sizeof(uint64_t));
+
+  // Input stays mapped until the output is complete
+  std::string tmpPath = std::string(argv[2]) + ".tmp";
+  FILE *file = fopen(tmpPath.c_str(), "wb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Can not write %s\n", tmpPath.c_str());
+    return 1;
+  }
+
+  bool status = (fwrite(out.data(), 1, out.size(), file) == out.size());
+  status = (fclose(file) == 0) && status;
+  if (!status || rename(tmpPath.c_str(), argv[2]))
+  {
+    fprintf(stderr, "Can not write %s\n", argv[2]);
+    remove(tmpPath.c_str());
+    return 1;
+  }
+
+  return 0;
+}